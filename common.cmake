@@ -40,7 +40,7 @@ if(NOT PROJECT_VERSION)
 endif()
 
 if(${CMAKE_SYSTEM_NAME} STREQUAL Windows)
-    add_compile_definitions(UNICODE _UNICODE WIN32_LEAN_AND_MEAN _CRT_SECURE_NO_WARNINGS K_WINDOWS)
+    add_compile_definitions(UNICODE _UNICODE WIN32_LEAN_AND_MEAN NOMINMAX _CRT_SECURE_NO_WARNINGS K_WINDOWS)
 elseif(${CMAKE_SYSTEM_NAME} STREQUAL Linux)
     add_compile_definitions(K_LINUX)
 endif()
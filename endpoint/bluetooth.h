@@ -41,6 +41,8 @@ public:
     virtual void close() override;
     virtual int send(const char* buffer, int size) override;
     virtual int recv(char* buffer, int size) override;
+    virtual int sendv(const const_buffer* buffers, int count) override;
+    virtual int recvv(const mutable_buffer* buffers, int count) override;
 
 private:
     bool init_service();
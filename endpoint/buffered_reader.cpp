@@ -0,0 +1,127 @@
+/*
+  MIT License
+
+  Copyright (c) 2025 Kong Pengsheng
+
+  Permission is hereby granted, free of charge, to any person obtaining a copy
+  of this software and associated documentation files (the "Software"), to deal
+  in the Software without restriction, including without limitation the rights
+  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+  copies of the Software, and to permit persons to whom the Software is
+  furnished to do so, subject to the following conditions:
+
+  The above copyright notice and this permission notice shall be included in all
+  copies or substantial portions of the Software.
+
+  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+  SOFTWARE.
+*/
+
+#include "buffered_reader.h"
+#include <algorithm>
+#include <cstring>
+
+buffered_reader::buffered_reader(endpoint* ep, int buffer_size)
+    : m_endpoint(ep),
+      m_buffer_size(std::max(buffer_size, 1)),
+      m_begin(0),
+      m_end(0) {
+    m_buffer = new char[m_buffer_size];
+}
+
+buffered_reader::~buffered_reader() {
+    delete[] m_buffer;
+}
+
+bool buffered_reader::read(char* buffer, int size) {
+    if (!buffer || size <= 0) {
+        return false;
+    }
+
+    int count = std::min(size, buffered());
+    memcpy(buffer, m_buffer + m_begin, count);
+    m_begin += count;
+    if (count == size) {
+        return true;
+    }
+
+    // what would not fit the buffer anyway goes straight to the caller
+    if (m_buffer_size <= size - count) {
+        return m_endpoint->full_recv(buffer + count, size - count);
+    }
+
+    if (!fill(size - count)) {
+        return false;
+    }
+
+    memcpy(buffer + count, m_buffer + m_begin, size - count);
+    m_begin += size - count;
+    return true;
+}
+
+int buffered_reader::read_some(char* buffer, int size) {
+    if (!buffer || size <= 0) {
+        return 0;
+    }
+
+    if (!buffered()) {
+        if (m_buffer_size <= size) {
+            return m_endpoint->recv(buffer, size);
+        }
+
+        if (!fill(1)) {
+            return 0;
+        }
+    }
+
+    int count = std::min(size, buffered());
+    memcpy(buffer, m_buffer + m_begin, count);
+    m_begin += count;
+    return count;
+}
+
+int buffered_reader::read_frame(char* buffer, int size, frame_size_handler handler) {
+    if (!buffer || size <= 0 || !handler) {
+        return -1;
+    }
+
+    int frame_size = 0;
+    while (!(frame_size = handler(m_buffer + m_begin, buffered()))) {
+        if (buffered() == m_buffer_size || !fill(buffered() + 1)) {
+            return buffered() == m_buffer_size ? -1 : 0;
+        }
+    }
+
+    if (frame_size < 0 || size < frame_size) {
+        return -1;
+    }
+
+    return read(buffer, frame_size) ? frame_size : 0;
+}
+
+// receives until at least size bytes are buffered, size is at most the buffer size
+bool buffered_reader::fill(int size) {
+    if (!buffered()) {
+        m_begin = m_end = 0;
+    } else if (m_buffer_size - m_begin < size) {
+        memmove(m_buffer, m_buffer + m_begin, buffered());
+        m_end -= m_begin;
+        m_begin = 0;
+    }
+
+    while (buffered() < size) {
+        int res = m_endpoint->recv(m_buffer + m_end, m_buffer_size - m_end);
+        if (res <= 0) {
+            return false;
+        }
+
+        m_end += res;
+    }
+
+    return true;
+}
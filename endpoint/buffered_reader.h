@@ -0,0 +1,68 @@
+/*
+  MIT License
+
+  Copyright (c) 2025 Kong Pengsheng
+
+  Permission is hereby granted, free of charge, to any person obtaining a copy
+  of this software and associated documentation files (the "Software"), to deal
+  in the Software without restriction, including without limitation the rights
+  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+  copies of the Software, and to permit persons to whom the Software is
+  furnished to do so, subject to the following conditions:
+
+  The above copyright notice and this permission notice shall be included in all
+  copies or substantial portions of the Software.
+
+  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+  SOFTWARE.
+*/
+
+#ifndef BUFFERED_READER_H
+#define BUFFERED_READER_H
+
+#include "endpoint.h"
+#include "function_ref.h"
+
+// reads ahead from a byte stream endpoint in large pieces and hands out exact byte
+// counts or whole frames from what it holds, so a framed protocol pays one recv per
+// buffer full instead of one per field. one reading thread at a time, not for UDP.
+class buffered_reader {
+public:
+    // size of the frame starting at buffer once enough of its head is there, 0 while
+    // more is needed, negative when the bytes cannot start a frame.
+    using frame_size_handler = function_ref<int(const char* buffer, int size)>;
+
+public:
+    explicit buffered_reader(endpoint* ep, int buffer_size = 1024 * 64);
+    buffered_reader(const buffered_reader&) = delete;
+    ~buffered_reader();
+
+    buffered_reader& operator=(const buffered_reader&) = delete;
+
+public:
+    // waits for exactly size bytes, false once the endpoint gives no more.
+    bool read(char* buffer, int size);
+    // what is buffered, or what one recv brings when nothing is, like recv.
+    int read_some(char* buffer, int size);
+    // copies one whole frame into buffer and returns its size, 0 once the endpoint
+    // gives no more, -1 when handler rejects it or it does not fit in buffer.
+    int read_frame(char* buffer, int size, frame_size_handler handler);
+    int buffered() const { return m_end - m_begin; }
+    // drops what is buffered, for a new connection of the endpoint.
+    void reset() { m_begin = m_end = 0; }
+
+private:
+    bool fill(int size);
+
+private:
+    endpoint* m_endpoint;
+    char* m_buffer;
+    int m_buffer_size, m_begin, m_end;
+};
+
+#endif
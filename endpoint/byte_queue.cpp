@@ -24,25 +24,181 @@
 
 #include "byte_queue.h"
 #include <cstring>
+#include <algorithm>
+#include <atomic>
+#include <map>
+#include <vector>
+#if defined K_LINUX
+#include <unistd.h>
+#include <sys/mman.h>
+#endif
 
 const int DEFAULT_BUFFER_SIZE = 64;
+const size_t MAX_POOLED_CHUNKS = 64;
+// powers of two from here are whole pages everywhere
+const int MIN_RING_SIZE = 1024 * 64;
+const int MAX_RING_SIZE = 1024 * 1024 * 1024;
+const int SHRINK_SIZE = 1024 * 64;
+
+static std::atomic<long long> s_memory_used(0);
+static std::atomic<long long> s_memory_budget(0);
+
+static void charge(long long size) {
+    s_memory_used.fetch_add(size, std::memory_order_relaxed);
+}
+
+struct chunk_pool {
+    std::mutex mutex;
+    std::map<int, std::vector<char*>> chunks;
+};
+
+// never destroyed, queues living in statics may still give chunks back at exit
+static chunk_pool& get_pool() {
+    static chunk_pool* pool = new chunk_pool;
+    return *pool;
+}
+
+static char* get_chunk(int size) {
+    charge(size);
+    chunk_pool& pool = get_pool();
+    {
+        std::lock_guard<std::mutex> lock(pool.mutex);
+        std::vector<char*>& chunks = pool.chunks[size];
+        if (!chunks.empty()) {
+            char* chunk = chunks.back();
+            chunks.pop_back();
+            return chunk;
+        }
+    }
+
+    return new char[size];
+}
+
+static void put_chunk(char* chunk, int size) {
+    charge(-size);
+    chunk_pool& pool = get_pool();
+    {
+        std::lock_guard<std::mutex> lock(pool.mutex);
+        std::vector<char*>& chunks = pool.chunks[size];
+        if (chunks.size() < MAX_POOLED_CHUNKS) {
+            chunks.push_back(chunk);
+            return;
+        }
+    }
+
+    delete[] chunk;
+}
+
+// the same pages twice in a row, what runs off the end of the first copy is the start
+// of the second
+static char* map_ring(int size) {
+#if defined K_LINUX
+    int fd = memfd_create("byte-queue", MFD_CLOEXEC);
+    if (fd < 0) {
+        return nullptr;
+    }
+
+    char* ring = nullptr;
+    void* base = MAP_FAILED;
+    if (0 == ftruncate(fd, size)) {
+        base = mmap(nullptr, (size_t)size * 2, PROT_NONE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    }
+
+    if (MAP_FAILED != base) {
+        ring = (char*)base;
+        for (size_t half = 0; half < 2; ++half) {
+            if (MAP_FAILED == mmap(ring + size * half, size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_FIXED, fd, 0)) {
+                munmap(base, (size_t)size * 2);
+                ring = nullptr;
+                break;
+            }
+        }
+    }
+
+    ::close(fd);
+    return ring;
+#else
+    (void)size;
+    return nullptr;
+#endif
+}
+
+static void unmap_ring(char* ring, int size) {
+#if defined K_LINUX
+    if (ring) {
+        munmap(ring, (size_t)size * 2);
+    }
+#else
+    (void)ring;
+    (void)size;
+#endif
+}
 
 byte_queue::byte_queue()
-    : m_buffer_size(DEFAULT_BUFFER_SIZE),
-      m_begin(0),
+    : m_begin(0),
       m_end(0),
+      m_mirrored(false),
+      m_chunk_size(0),
+      m_front(0),
+      m_back(0),
+      m_reserved(0),
+      m_peak(0),
+      m_high(0),
+      m_low(0),
+      m_policy(BLOCK),
+      m_full(false),
+      m_waiters(0),
+      m_wait_mode(WAIT_BLOCK),
+      m_spins(0),
+      m_wakes(0),
       m_exiting(false) {
-    m_buffer = new char[m_buffer_size + 1];
+    alloc_buffer(DEFAULT_BUFFER_SIZE);
+    m_buffer[m_end] = 0;
+}
+
+byte_queue::byte_queue(int chunk_size)
+    : m_begin(0),
+      m_end(0),
+      m_mirrored(MIRRORED == chunk_size),
+      m_chunk_size(std::max(chunk_size, 0)),
+      m_front(0),
+      m_back(0),
+      m_reserved(0),
+      m_peak(0),
+      m_high(0),
+      m_low(0),
+      m_policy(BLOCK),
+      m_full(false),
+      m_waiters(0),
+      m_wait_mode(WAIT_BLOCK),
+      m_spins(0),
+      m_wakes(0),
+      m_exiting(false) {
+    alloc_buffer(DEFAULT_BUFFER_SIZE);
     m_buffer[m_end] = 0;
 }
 
 byte_queue::byte_queue(const byte_queue& other)
-    : m_buffer_size(other.size()),
-      m_begin(0),
-      m_end(other.size()),
+    : m_begin(0),
+      m_end(0),
+      m_mirrored(other.m_mirrored),
+      m_chunk_size(other.m_chunk_size),
+      m_front(0),
+      m_back(0),
+      m_reserved(0),
+      m_peak(0),
+      m_high(other.m_high),
+      m_low(other.m_low),
+      m_policy(other.m_policy),
+      m_full(false),
+      m_waiters(0),
+      m_wait_mode(other.m_wait_mode),
+      m_spins(other.m_spins),
+      m_wakes(0),
       m_exiting(false) {
-    m_buffer = new char[m_buffer_size + 1];
-    memcpy(m_buffer, other.m_buffer + other.m_begin, other.size());
+    alloc_buffer(other.m_chunk_size ? DEFAULT_BUFFER_SIZE : other.size());
+    m_buffer[m_end] = 0;
+    copy_from(other);
 }
 
 byte_queue::byte_queue(byte_queue&& other) noexcept
@@ -50,26 +206,50 @@ byte_queue::byte_queue(byte_queue&& other) noexcept
       m_buffer_size(other.m_buffer_size),
       m_begin(other.m_begin),
       m_end(other.m_end),
+      m_mirrored(other.m_mirrored),
+      m_chunk_size(other.m_chunk_size),
+      m_chunks(std::move(other.m_chunks)),
+      m_front(other.m_front),
+      m_back(other.m_back),
+      m_reserved(0),
+      m_peak(other.m_peak),
+      m_high(other.m_high),
+      m_low(other.m_low),
+      m_policy(other.m_policy),
+      m_full(false),
+      m_waiters(0),
+      m_on_writable(std::move(other.m_on_writable)),
+      m_on_readable(std::move(other.m_on_readable)),
+      m_wait_mode(other.m_wait_mode),
+      m_spins(other.m_spins),
+      m_wakes(0),
       m_exiting(false) {
     other.m_buffer = nullptr;
     other.m_buffer_size = other.m_begin = other.m_end = 0;
+    other.m_mirrored = false;
+    other.m_chunks.clear();
+    other.m_front = other.m_back = 0;
+    other.m_reserved = 0;
     other.m_exiting = false;
 }
 
 byte_queue::~byte_queue() {
-    delete[] m_buffer;
+    release_chunks();
+    free_buffer();
 }
 
 byte_queue& byte_queue::operator=(const byte_queue& other) {
     if (this != &other) {
-        if (m_buffer_size < other.size()) {
-            delete[] m_buffer;
-            m_buffer_size = other.size();
-            m_buffer = new char[m_buffer_size + 1];
-        }
+        release_chunks();
+        free_buffer();
+        m_mirrored = other.m_mirrored;
+        m_chunk_size = other.m_chunk_size;
+        alloc_buffer(m_chunk_size ? DEFAULT_BUFFER_SIZE : other.size());
         m_begin = 0;
-        m_end = other.size();
-        memcpy(m_buffer, other.m_buffer + other.m_begin, other.size());
+        m_end = 0;
+        m_reserved = 0;
+        m_buffer[m_end] = 0;
+        copy_from(other);
     }
 
     return *this;
@@ -81,6 +261,23 @@ byte_queue& byte_queue::operator=(byte_queue&& other) noexcept {
         std::swap(m_buffer_size, other.m_buffer_size);
         std::swap(m_begin, other.m_begin);
         std::swap(m_end, other.m_end);
+        std::swap(m_mirrored, other.m_mirrored);
+        std::swap(m_chunk_size, other.m_chunk_size);
+        std::swap(m_chunks, other.m_chunks);
+        std::swap(m_front, other.m_front);
+        std::swap(m_back, other.m_back);
+        std::swap(m_reserved, other.m_reserved);
+        std::swap(m_peak, other.m_peak);
+        // the limits and notifies go with the bytes they watch. the budget is charged
+        // per buffer and chunk, so its charge moves along with them
+        std::swap(m_high, other.m_high);
+        std::swap(m_low, other.m_low);
+        std::swap(m_policy, other.m_policy);
+        std::swap(m_full, other.m_full);
+        std::swap(m_on_writable, other.m_on_writable);
+        std::swap(m_on_readable, other.m_on_readable);
+        std::swap(m_wait_mode, other.m_wait_mode);
+        std::swap(m_spins, other.m_spins);
     }
 
     return *this;
@@ -91,118 +288,549 @@ int byte_queue::put(bytes_handler handler, int size) {
         return 0;
     }
 
-    std::lock_guard<std::mutex> lock(m_mutex);
-
-    if (m_exiting) {
+    std::unique_lock<std::mutex> lock(m_mutex);
+    if (!admit(lock, size)) {
         return 0;
     }
 
-    int need_size = m_end - m_begin + size;
-    if (m_buffer_size < need_size) {
-        m_buffer_size = need_size + need_size / 2;
-        char* new_buffer = new char[m_buffer_size + 1];
-        if (m_begin < m_end) {
-            memcpy(new_buffer, m_buffer + m_begin, m_end - m_begin);
-            m_end -= m_begin;
-            m_begin = 0;
+    bool readable = !used();
+    if (m_chunk_size) {
+        size = put_chunks(handler, size);
+    } else {
+        char* buffer = make_room(size);
+        size = handler(buffer, room());
+        if (0 < size) {
+            m_end += size;
         }
-        delete[] m_buffer;
-        m_buffer = new_buffer;
+
+        m_buffer[m_end] = 0;
     }
 
-    if (m_begin && m_begin == m_end) {
-        m_begin = m_end = 0;
+    m_peak = std::max(m_peak, used());
+    wake_takers();
+    notify_levels(lock, readable && 0 < size);
+
+    return size;
+}
+
+int byte_queue::put(const char* src, int size) {
+    if (!src || size <= 0) {
+        return 0;
     }
 
-    if (m_buffer_size - m_end < size) {
-        memmove(m_buffer, m_buffer + m_begin, m_end - m_begin);
-        m_end -= m_begin;
-        m_begin = 0;
+    std::unique_lock<std::mutex> lock(m_mutex);
+    if (!admit(lock, size)) {
+        return 0;
     }
 
-    size = handler(m_buffer + m_end, m_buffer_size - m_end);
+    bool readable = !used();
+    append(src, size);
+    m_peak = std::max(m_peak, used());
+    wake_takers();
+    notify_levels(lock, readable);
+
+    return size;
+}
+
+int byte_queue::take(bytes_handler handler, bool wait) {
+    if (!handler) {
+        return 0;
+    }
+
+    std::unique_lock<std::mutex> lock(m_mutex);
+    if (!wait_bytes(lock, wait)) {
+        return 0;
+    }
+
+    int size = m_chunk_size ? handler(m_chunks.front() + m_front, first_piece())
+                            : handler(m_buffer + m_begin, m_end - m_begin);
     if (0 < size) {
-        m_end += size;
+        drop(size);
     }
 
-    m_buffer[m_end] = 0;
-    m_cond_has_bytes.notify_all();
+    notify_levels(lock, false);
 
     return size;
 }
 
-int byte_queue::put(const char* src, int size) {
-    if (!src || size <= 0) {
+int byte_queue::take(char* dest, int size, bool wait) {
+    if (!dest || size <= 0) {
         return 0;
     }
 
-    bytes_handler handler = [src, size](char* dest, int dest_size) {
-        if (dest_size < size) {
-            return 0;
-        }
-        memcpy(dest, src, size);
-        return size;
-    };
+    std::unique_lock<std::mutex> lock(m_mutex);
+    if (!wait_bytes(lock, wait)) {
+        return 0;
+    }
+
+    size = std::min(size, used());
+    copy_out(dest, size);
+    drop(size);
+    notify_levels(lock, false);
 
-    return put(handler, size);
+    return size;
 }
 
-int byte_queue::take(bytes_handler handler, bool wait) {
+int byte_queue::take_contiguous(bytes_handler handler, int size, bool wait) {
     if (!handler) {
         return 0;
     }
 
-    auto condition = [this] { return m_begin < m_end; };
     std::unique_lock<std::mutex> lock(m_mutex);
-
-    if (wait) {
-        m_cond_has_bytes.wait(lock, [this, condition] { return m_exiting || condition(); });
-    } else if (!condition()) {
+    if (!wait_bytes(lock, wait)) {
         return 0;
     }
 
-    if (m_exiting) {
-        return 0;
+    size = std::min(size, used());
+    if (!m_chunk_size) {
+        size = handler(m_buffer + m_begin, m_end - m_begin);
+    } else if (size <= first_piece()) {
+        size = handler(m_chunks.front() + m_front, first_piece());
+    } else {
+        // joined in the scratch buffer, the one copy asked for
+        if (m_buffer_size < size) {
+            free_buffer();
+            alloc_buffer(size);
+        }
+
+        copy_out(m_buffer, size);
+        size = handler(m_buffer, size);
     }
 
-    int size = handler(m_buffer + m_begin, m_end - m_begin);
     if (0 < size) {
-        m_begin += size;
+        drop(size);
     }
 
+    notify_levels(lock, false);
+
     return size;
 }
 
-int byte_queue::take(char* dest, int size, bool wait) {
-    if (!dest || size <= 0) {
+int byte_queue::peek(const char*& data, bool wait) {
+    std::unique_lock<std::mutex> lock(m_mutex);
+    if (!wait_bytes(lock, wait)) {
+        data = nullptr;
         return 0;
     }
 
-    bytes_handler handler = [dest, &size](char* src, int src_size) {
-        if (src_size < size) {
-            size = src_size;
-        }
-        memcpy(dest, src, size);
-        return size;
-    };
+    if (m_chunk_size) {
+        data = m_chunks.front() + m_front;
+        return first_piece();
+    }
 
-    return take(handler, wait);
+    data = m_buffer + m_begin;
+    return m_end - m_begin;
+}
+
+int byte_queue::consume(int size) {
+    std::unique_lock<std::mutex> lock(m_mutex);
+    size = std::min(size, used());
+    if (size <= 0) {
+        return 0;
+    }
+
+    drop(size);
+    notify_levels(lock, false);
+
+    return size;
+}
+
+int byte_queue::reserve(char*& buffer, int size) {
+    std::unique_lock<std::mutex> lock(m_mutex);
+    buffer = nullptr;
+    m_reserved = 0;
+    if (size <= 0 || !admit(lock, size)) {
+        return 0;
+    }
+
+    if (m_chunk_size) {
+        m_reserved = back_room();
+        buffer = m_chunks.back() + m_back;
+    } else {
+        buffer = make_room(size);
+        m_reserved = room();
+    }
+
+    return m_reserved;
+}
+
+int byte_queue::commit(int size) {
+    std::unique_lock<std::mutex> lock(m_mutex);
+    size = std::min(size, m_reserved);
+    m_reserved = 0;
+    if (m_exiting || size <= 0) {
+        return 0;
+    }
+
+    bool readable = !used();
+    if (m_chunk_size) {
+        m_back += size;
+    } else {
+        m_end += size;
+        m_buffer[m_end] = 0;
+    }
+
+    m_peak = std::max(m_peak, used());
+    wake_takers();
+    notify_levels(lock, readable);
+
+    return size;
 }
 
 int byte_queue::size() const {
     std::lock_guard<std::mutex> lock(m_mutex);
-    return m_end - m_begin;
+    return used();
 }
 
 void byte_queue::exit() {
     std::lock_guard<std::mutex> lock(m_mutex);
     m_exiting = true;
-    m_cond_has_bytes.notify_all();
+    wake_takers();
+    m_cond_has_room.notify_all();
 }
 
 void byte_queue::reset() {
     std::lock_guard<std::mutex> lock(m_mutex);
+    release_chunks();
     m_begin = m_end = 0;
+    m_reserved = 0;
+    shrink_buffer();
     m_buffer[m_end] = 0;
+    m_full = false;
     m_exiting = false;
+    m_cond_has_room.notify_all();
+}
+
+void byte_queue::set_watermarks(int high, int low, full_policy policy) {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_high = std::max(high, 0);
+    m_low = std::min(std::max(low, 0), m_high);
+    m_policy = policy;
+    m_cond_has_room.notify_all();
+}
+
+void byte_queue::set_notify(level_notify on_writable, level_notify on_readable) {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_on_writable = on_writable;
+    m_on_readable = on_readable;
+}
+
+void byte_queue::set_wait(wait_mode mode, int spins) {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_wait_mode = mode;
+    m_spins = std::max(spins, 0);
+}
+
+void byte_queue::set_memory_budget(long long bytes) {
+    s_memory_budget.store(std::max(bytes, 0LL), std::memory_order_relaxed);
+}
+
+long long byte_queue::memory_used() {
+    return s_memory_used.load(std::memory_order_relaxed);
+}
+
+int byte_queue::used() const {
+    if (!m_chunk_size) {
+        return m_end - m_begin;
+    }
+
+    return m_chunks.empty() ? 0 : (int)(m_chunks.size() - 1) * m_chunk_size - m_front + m_back;
+}
+
+// below the high watermark after the put, and within the budget if it needs more memory
+bool byte_queue::has_space(int size) const {
+    int queued = used();
+    if (!queued) {
+        return true;
+    }
+
+    if (m_high && m_high < queued + size) {
+        return false;
+    }
+
+    long long budget = s_memory_budget.load(std::memory_order_relaxed);
+    if (!budget) {
+        return true;
+    }
+
+    int spare = m_chunk_size ? (m_chunks.empty() ? 0 : m_chunk_size - m_back)
+                             : (m_mirrored ? room() : m_buffer_size - queued);
+    return size <= spare || s_memory_used.load(std::memory_order_relaxed) + size <= budget;
+}
+
+// a producer held back by the budget alone waits for its own queue to run dry, the
+// memory other queues give back wakes no one
+bool byte_queue::admit(std::unique_lock<std::mutex>& lock, int size) {
+    if (!m_exiting && !has_space(size)) {
+        m_full = true;
+        if (FAIL == m_policy) {
+            return false;
+        }
+
+        ++m_waiters;
+        m_cond_has_room.wait(lock, [this, size] { return m_exiting || (used() <= m_low && has_space(size)); });
+        --m_waiters;
+    }
+
+    return !m_exiting;
+}
+
+// last thing under the lock, the notify runs after it is released
+void byte_queue::notify_levels(std::unique_lock<std::mutex>& lock, bool readable) {
+    level_notify notify;
+    if (readable) {
+        notify = m_on_readable;
+    } else if (used() <= m_low) {
+        if (m_waiters) {
+            m_cond_has_room.notify_all();
+        }
+
+        if (m_full) {
+            m_full = false;
+            notify = m_on_writable;
+        }
+    }
+
+    lock.unlock();
+    if (notify) {
+        notify();
+    }
+}
+
+// under the lock, a take spinning outside of it sees the count move
+void byte_queue::wake_takers() {
+    m_wakes.fetch_add(1, std::memory_order_release);
+    m_cond_has_bytes.notify_all();
+}
+
+int byte_queue::first_piece() const {
+    return 1 == m_chunks.size() ? m_back - m_front : m_chunk_size - m_front;
+}
+
+// a mirrored ring keeps one byte spare, the terminator must not land on the front
+int byte_queue::room() const {
+    return m_mirrored ? m_buffer_size - 1 - (m_end - m_begin) : m_buffer_size - m_end;
+}
+
+// the last chunk with room in it, a fresh one once it is full
+int byte_queue::back_room() {
+    if (m_chunks.empty() || m_chunk_size == m_back) {
+        m_chunks.push_back(get_chunk(m_chunk_size));
+        m_back = 0;
+    }
+
+    return m_chunk_size - m_back;
+}
+
+// room for size more bytes at the end of the buffer, growing it or moving the bytes
+// to the front when needed. a mirrored ring only ever grows
+char* byte_queue::make_room(int size) {
+    int need_size = m_end - m_begin + size;
+    if (m_mirrored) {
+        if (room() < size) {
+            char* ring = m_buffer;
+            int ring_size = m_buffer_size;
+            alloc_buffer(need_size + need_size / 2);
+            memcpy(m_buffer, ring + m_begin, m_end - m_begin);
+            unmap_ring(ring, ring_size);
+            charge(-ring_size);
+            m_end -= m_begin;
+            m_begin = 0;
+        }
+
+        return m_buffer + m_end;
+    }
+
+    if (m_buffer_size < need_size) {
+        charge(need_size + need_size / 2 - m_buffer_size);
+        m_buffer_size = need_size + need_size / 2;
+        char* new_buffer = new char[m_buffer_size + 1];
+        if (m_begin < m_end) {
+            memcpy(new_buffer, m_buffer + m_begin, m_end - m_begin);
+            m_end -= m_begin;
+            m_begin = 0;
+        }
+        delete[] m_buffer;
+        m_buffer = new_buffer;
+    }
+
+    if (m_begin && m_begin == m_end) {
+        m_begin = m_end = 0;
+    }
+
+    if (m_buffer_size - m_end < size) {
+        memmove(m_buffer, m_buffer + m_begin, m_end - m_begin);
+        m_end -= m_begin;
+        m_begin = 0;
+    }
+
+    return m_buffer + m_end;
+}
+
+// the handler fills one chunk at a time and is done once it fills less than offered
+int byte_queue::put_chunks(bytes_handler& handler, int size) {
+    int count = 0;
+    while (count < size) {
+        int piece = std::min(size - count, back_room());
+        int res = handler(m_chunks.back() + m_back, piece);
+        if (0 < res) {
+            m_back += res;
+            count += res;
+        }
+
+        if (res < piece) {
+            break;
+        }
+    }
+
+    return count;
+}
+
+void byte_queue::append(const char* src, int size) {
+    if (!m_chunk_size) {
+        memcpy(make_room(size), src, size);
+        m_end += size;
+        m_buffer[m_end] = 0;
+        return;
+    }
+
+    while (0 < size) {
+        int piece = std::min(size, back_room());
+        memcpy(m_chunks.back() + m_back, src, piece);
+        m_back += piece;
+        src += piece;
+        size -= piece;
+    }
+}
+
+void byte_queue::copy_from(const byte_queue& other) {
+    if (!other.m_chunk_size) {
+        if (other.m_begin < other.m_end) {
+            append(other.m_buffer + other.m_begin, other.m_end - other.m_begin);
+        }
+        return;
+    }
+
+    for (size_t i = 0; i < other.m_chunks.size(); ++i) {
+        int begin = i ? 0 : other.m_front;
+        int end = i + 1 < other.m_chunks.size() ? other.m_chunk_size : other.m_back;
+        append(other.m_chunks[i] + begin, end - begin);
+    }
+}
+
+void byte_queue::copy_out(char* dest, int size) const {
+    if (!m_chunk_size) {
+        memcpy(dest, m_buffer + m_begin, size);
+        return;
+    }
+
+    int offset = m_front;
+    for (size_t i = 0; 0 < size; ++i) {
+        int piece = std::min(size, (i + 1 < m_chunks.size() ? m_chunk_size : m_back) - offset);
+        memcpy(dest, m_chunks[i] + offset, piece);
+        dest += piece;
+        size -= piece;
+        offset = 0;
+    }
+}
+
+void byte_queue::drop(int size) {
+    if (!m_chunk_size) {
+        m_begin += size;
+        // past the first copy of a mirrored ring the same bytes are in the first
+        if (m_mirrored && m_buffer_size <= m_begin) {
+            m_begin -= m_buffer_size;
+            m_end -= m_buffer_size;
+        }
+    } else {
+        m_front += size;
+        while (1 < m_chunks.size() && m_chunk_size <= m_front) {
+            put_chunk(m_chunks.front(), m_chunk_size);
+            m_chunks.pop_front();
+            m_front -= m_chunk_size;
+        }
+
+        // the last chunk is kept for the next put once it runs empty, where it is
+        // unless a writer has room reserved in it
+        if (1 == m_chunks.size() && m_back <= m_front && !m_reserved) {
+            m_front = m_back = 0;
+        }
+    }
+
+    if (!used() && !m_reserved) {
+        shrink_buffer();
+    }
+}
+
+bool byte_queue::wait_bytes(std::unique_lock<std::mutex>& lock, bool wait) {
+    if (wait) {
+        while (WAIT_BLOCK != m_wait_mode && !m_exiting && !used()) {
+            if (!spin_until_woken(lock, m_wakes, m_wait_mode, m_spins)) {
+                break;
+            }
+        }
+
+        m_cond_has_bytes.wait(lock, [this] { return m_exiting || 0 < used(); });
+    } else if (!used()) {
+        return false;
+    }
+
+    return !m_exiting;
+}
+
+void byte_queue::release_chunks() {
+    for (char* chunk : m_chunks) {
+        put_chunk(chunk, m_chunk_size);
+    }
+
+    m_chunks.clear();
+    m_front = m_back = 0;
+}
+
+void byte_queue::alloc_buffer(int size) {
+    if (m_mirrored) {
+        int ring_size = MIN_RING_SIZE;
+        while (ring_size <= size && ring_size < MAX_RING_SIZE) {
+            ring_size *= 2;
+        }
+
+        m_buffer = size < ring_size ? map_ring(ring_size) : nullptr;
+        if (m_buffer) {
+            m_buffer_size = ring_size;
+            charge(m_buffer_size);
+            return;
+        }
+
+        // a plain buffer does the same with moves
+        m_mirrored = false;
+    }
+
+    m_buffer_size = size;
+    m_buffer = new char[m_buffer_size + 1];
+    charge(m_buffer_size);
+}
+
+void byte_queue::free_buffer() {
+    if (m_mirrored) {
+        unmap_ring(m_buffer, m_buffer_size);
+    } else {
+        delete[] m_buffer;
+    }
+
+    charge(-m_buffer_size);
+    m_buffer = nullptr;
+    m_buffer_size = 0;
+}
+
+// a buffer grown for a burst goes back to its first size once the queue runs dry, unless
+// the round just over filled a good part of it. the joining scratch of chunk mode always
+void byte_queue::shrink_buffer() {
+    if (SHRINK_SIZE < m_buffer_size && (m_chunk_size || m_peak < m_buffer_size / 4)) {
+        free_buffer();
+        alloc_buffer(DEFAULT_BUFFER_SIZE);
+        m_begin = m_end = 0;
+        m_buffer[m_end] = 0;
+    }
+
+    m_peak = 0;
 }
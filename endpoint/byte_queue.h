@@ -25,15 +25,42 @@
 #ifndef BYTE_QUEUE_H
 #define BYTE_QUEUE_H
 
+#include <atomic>
+#include <deque>
 #include <functional>
 #include <mutex>
 #include <condition_variable>
+#include "function_ref.h"
+#include "spin_wait.h"
 
-using bytes_handler = std::function<int(char* buffer, int size)>;
+// called before the put or take returns, never kept
+using bytes_handler = function_ref<int(char* buffer, int size)>;
 
+// bytes put at the back and taken from the front. by default one buffer that grows and
+// moves what it holds to the front, given a chunk size a chain of chunks of that size
+// instead, where a put never moves bytes already in and spent chunks go back to a pool
+// shared by all queues. take with a handler then sees the bytes of the first chunk and
+// put with a handler fills one chunk per call, take_contiguous joins chunks on request.
+// MIRRORED is a ring whose pages are mapped twice back to back, so bytes never move and
+// the front is still in one piece where it wraps, it falls back to one buffer if the
+// platform can't map it. a buffer grown for a burst shrinks back once the queue runs dry
+// after a round that used little of it.
 class byte_queue {
+public:
+    static const int CHUNK_SIZE = 1024 * 64;
+    static const int MIRRORED = -1;
+
+    // what a put does when the queue is full
+    enum full_policy {
+        BLOCK,
+        FAIL
+    };
+
+    using level_notify = std::function<void()>;
+
 public:
     byte_queue();
+    explicit byte_queue(int chunk_size);
     byte_queue(const byte_queue& other);
     byte_queue(byte_queue&& other) noexcept;
     ~byte_queue();
@@ -46,16 +73,77 @@ public:
     int put(const char* src, int size);
     int take(bytes_handler handler, bool wait = true);
     int take(char* dest, int size, bool wait = true);
+    // the handler sees at least size bytes in one piece, or all there are when fewer
+    int take_contiguous(bytes_handler handler, int size, bool wait = true);
+    // the bytes at the front left in the queue, the first chunk's in chunk mode. they stay
+    // put until consumed, or until a put moves them in linear mode
+    int peek(const char*& data, bool wait = true);
+    int consume(int size);
+    // room at the back for one writer to fill in place, at least size bytes but only up to
+    // the end of the last chunk in chunk mode. take sees nothing of it before commit
+    int reserve(char*& buffer, int size);
+    int commit(int size);
     int size() const;
     void exit();
     void reset();
 
+    // a put taking the queue past high bytes waits until takes bring it down to low, or
+    // fails with 0. an empty queue takes any put. 0 for no limit
+    void set_watermarks(int high, int low, full_policy policy = BLOCK);
+    // on_writable when a full queue is down to low, on_readable when bytes land in an
+    // empty one. both run on the thread that made the change, outside the lock
+    void set_notify(level_notify on_writable, level_notify on_readable);
+    // how a take waits on an empty queue, spins looks before it sleeps for WAIT_SPIN
+    void set_wait(wait_mode mode, int spins = 0);
+
+    // memory held by the buffers and chunks of all queues, and how much they may hold.
+    // past it a put needing more memory counts as full, 0 for no limit
+    static void set_memory_budget(long long bytes);
+    static long long memory_used();
+
+private:
+    int used() const;
+    int first_piece() const;
+    int back_room();
+    int room() const;
+    bool has_space(int size) const;
+    bool admit(std::unique_lock<std::mutex>& lock, int size);
+    void notify_levels(std::unique_lock<std::mutex>& lock, bool readable);
+    void wake_takers();
+    char* make_room(int size);
+    int put_chunks(bytes_handler& handler, int size);
+    void append(const char* src, int size);
+    void copy_from(const byte_queue& other);
+    void copy_out(char* dest, int size) const;
+    void drop(int size);
+    bool wait_bytes(std::unique_lock<std::mutex>& lock, bool wait);
+    void release_chunks();
+    void alloc_buffer(int size);
+    void free_buffer();
+    void shrink_buffer();
+
 private:
     char* m_buffer;
     int m_buffer_size, m_begin, m_end;
+    bool m_mirrored;
+    int m_chunk_size;
+    std::deque<char*> m_chunks;
+    int m_front, m_back;
+    int m_reserved;
+    int m_peak;
+    int m_high, m_low;
+    full_policy m_policy;
+    bool m_full;
+    int m_waiters;
+    level_notify m_on_writable, m_on_readable;
+    wait_mode m_wait_mode;
+    int m_spins;
+    // for spin_until_woken
+    std::atomic<unsigned> m_wakes;
     bool m_exiting;
     mutable std::mutex m_mutex;
     std::condition_variable m_cond_has_bytes;
+    std::condition_variable m_cond_has_room;
 };
 
 #endif
@@ -0,0 +1,237 @@
+/*
+  MIT License
+
+  Copyright (c) 2025 Kong Pengsheng
+
+  Permission is hereby granted, free of charge, to any person obtaining a copy
+  of this software and associated documentation files (the "Software"), to deal
+  in the Software without restriction, including without limitation the rights
+  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+  copies of the Software, and to permit persons to whom the Software is
+  furnished to do so, subject to the following conditions:
+
+  The above copyright notice and this permission notice shall be included in all
+  copies or substantial portions of the Software.
+
+  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+  SOFTWARE.
+*/
+
+#include "byte_ring.h"
+#include <algorithm>
+#include <cstring>
+#include <thread>
+#include <vector>
+
+const unsigned long long INITIAL_CAPACITY = 1024 * 4;
+const unsigned long long MAX_CAPACITY = 1ULL << 30;
+
+static void copy_in(char* ring, unsigned long long capacity, unsigned long long pos, const char* src, int size) {
+    unsigned long long offset = pos & (capacity - 1);
+    int first = (int)std::min<unsigned long long>(size, capacity - offset);
+    memcpy(ring + offset, src, first);
+    memcpy(ring, src + first, size - first);
+}
+
+static void copy_out(char* dest, const char* ring, unsigned long long capacity, unsigned long long pos, int size) {
+    unsigned long long offset = pos & (capacity - 1);
+    int first = (int)std::min<unsigned long long>(size, capacity - offset);
+    memcpy(dest, ring + offset, first);
+    memcpy(dest + first, ring, size - first);
+}
+
+byte_ring::byte_ring()
+    : m_capacity(INITIAL_CAPACITY),
+      m_wait_mode(WAIT_BLOCK),
+      m_spins(0),
+      m_head(0),
+      m_tail(0),
+      m_parked(false),
+      m_exiting(false),
+      m_taking(false),
+      m_growing(false) {
+    m_buffer = new char[m_capacity];
+}
+
+byte_ring::~byte_ring() {
+    delete[] m_buffer;
+}
+
+int byte_ring::put(bytes_handler handler, int size) {
+    if (!handler || size <= 0 || m_exiting) {
+        return 0;
+    }
+
+    if (!reserve(size)) {
+        return -1;
+    }
+
+    // the handler wants one piece, a run crossing the end is staged first
+    unsigned long long head = m_head.load(std::memory_order_relaxed);
+    unsigned long long offset = head & (m_capacity - 1);
+    if (size <= (int)(m_capacity - offset)) {
+        size = handler(m_buffer + offset, size);
+    } else {
+        static thread_local std::vector<char> staging;
+        staging.resize(size);
+        size = handler(staging.data(), size);
+        if (0 < size) {
+            copy_in(m_buffer, m_capacity, head, staging.data(), size);
+        }
+    }
+
+    if (size <= 0) {
+        return size;
+    }
+
+    m_head.store(head + size, std::memory_order_seq_cst);
+    if (m_parked.load(std::memory_order_seq_cst)) {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_cond_has_bytes.notify_one();
+    }
+
+    return size;
+}
+
+int byte_ring::put(const char* src, int size) {
+    if (!src || size <= 0) {
+        return 0;
+    }
+
+    return put([src, size](char* dest, int dest_size) {
+        memcpy(dest, src, size);
+        return size;
+    }, size);
+}
+
+int byte_ring::take(bytes_handler handler, bool wait) {
+    if (!handler || (wait ? !wait_bytes() : !size() || m_exiting)) {
+        return 0;
+    }
+
+    enter();
+    unsigned long long tail = m_tail.load(std::memory_order_relaxed);
+    unsigned long long offset = tail & (m_capacity - 1);
+    int available = (int)std::min(m_head.load(std::memory_order_acquire) - tail, m_capacity - offset);
+    int size = handler(m_buffer + offset, available);
+    if (0 < size) {
+        m_tail.store(tail + size, std::memory_order_release);
+    }
+    leave();
+
+    return size;
+}
+
+int byte_ring::take(char* dest, int size, bool wait) {
+    if (!dest || size <= 0 || (wait ? !wait_bytes() : !this->size() || m_exiting)) {
+        return 0;
+    }
+
+    enter();
+    unsigned long long tail = m_tail.load(std::memory_order_relaxed);
+    size = (int)std::min<unsigned long long>(size, m_head.load(std::memory_order_acquire) - tail);
+    copy_out(dest, m_buffer, m_capacity, tail, size);
+    m_tail.store(tail + size, std::memory_order_release);
+    leave();
+
+    return size;
+}
+
+int byte_ring::size() const {
+    unsigned long long tail = m_tail.load(std::memory_order_acquire);
+    return (int)(m_head.load(std::memory_order_acquire) - tail);
+}
+
+void byte_ring::exit() {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_exiting = true;
+    m_cond_has_bytes.notify_all();
+}
+
+void byte_ring::reset() {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_head = m_tail = 0;
+    m_exiting = false;
+}
+
+void byte_ring::set_wait(wait_mode mode, int spins) {
+    m_wait_mode = mode;
+    m_spins = std::max(spins, 0);
+}
+
+// makes room for size more bytes, doubling while the consumer is kept out
+bool byte_ring::reserve(int size) {
+    unsigned long long used = m_head.load(std::memory_order_relaxed) - m_tail.load(std::memory_order_acquire);
+    if (used + size <= m_capacity) {
+        return true;
+    }
+
+    unsigned long long capacity = m_capacity;
+    while (capacity < used + size) {
+        capacity *= 2;
+    }
+
+    if (MAX_CAPACITY < capacity) {
+        return false;
+    }
+
+    char* buffer = new char[capacity];
+    m_growing.store(true);
+    while (m_taking.load()) {
+        std::this_thread::yield();
+    }
+
+    unsigned long long tail = m_tail.load(std::memory_order_relaxed);
+    unsigned long long count = m_head.load(std::memory_order_relaxed) - tail;
+    for (unsigned long long pos = tail; pos < tail + count;) {
+        unsigned long long offset = pos & (m_capacity - 1);
+        int piece = (int)std::min(tail + count - pos, m_capacity - offset);
+        copy_in(buffer, capacity, pos, m_buffer + offset, piece);
+        pos += piece;
+    }
+
+    delete[] m_buffer;
+    m_buffer = buffer;
+    m_capacity = capacity;
+    m_growing.store(false);
+    return true;
+}
+
+// spins as the wait mode says, then parks the consumer until bytes come or the ring
+// exits. the parked flag is set before looking again so a put either sees it or is seen
+bool byte_ring::wait_bytes() {
+    spin_until(m_wait_mode, m_spins, [this] { return size() || m_exiting; });
+    while (!size() && !m_exiting) {
+        std::unique_lock<std::mutex> lock(m_mutex);
+        m_parked.store(true, std::memory_order_seq_cst);
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        m_cond_has_bytes.wait(lock, [this] { return size() || m_exiting; });
+        m_parked.store(false, std::memory_order_relaxed);
+    }
+
+    return !m_exiting;
+}
+
+// the consumer and a growing producer each raise a flag and then look at the other's
+void byte_ring::enter() {
+    while (true) {
+        m_taking.store(true);
+        if (!m_growing.load()) {
+            return;
+        }
+
+        m_taking.store(false);
+        while (m_growing.load()) {
+            std::this_thread::yield();
+        }
+    }
+}
+
+void byte_ring::leave() {
+    m_taking.store(false, std::memory_order_release);
+}
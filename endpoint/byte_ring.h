@@ -0,0 +1,79 @@
+/*
+  MIT License
+
+  Copyright (c) 2025 Kong Pengsheng
+
+  Permission is hereby granted, free of charge, to any person obtaining a copy
+  of this software and associated documentation files (the "Software"), to deal
+  in the Software without restriction, including without limitation the rights
+  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+  copies of the Software, and to permit persons to whom the Software is
+  furnished to do so, subject to the following conditions:
+
+  The above copyright notice and this permission notice shall be included in all
+  copies or substantial portions of the Software.
+
+  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+  SOFTWARE.
+*/
+
+#ifndef BYTE_RING_H
+#define BYTE_RING_H
+
+#include <atomic>
+#include <mutex>
+#include <condition_variable>
+#include "byte_queue.h"
+#include "spin_wait.h"
+
+// byte_queue for exactly one producer thread and one consumer thread. bytes wrap around
+// a power of two ring without a lock, the consumer only takes the mutex to sleep and
+// the producer only to wake it. a full ring doubles, the consumer steps aside for that.
+// take with a handler sees the bytes up to where the ring wraps.
+class byte_ring {
+public:
+    byte_ring();
+    byte_ring(const byte_ring&) = delete;
+    ~byte_ring();
+
+    byte_ring& operator=(const byte_ring&) = delete;
+
+public:
+    // unlike byte_queue a put can fail: -1 when the ring would have to grow past 1GB,
+    // the bytes are not taken then, and 0 once the ring exits
+    int put(bytes_handler handler, int size);
+    int put(const char* src, int size);
+    int take(bytes_handler handler, bool wait = true);
+    int take(char* dest, int size, bool wait = true);
+    int size() const;
+    void exit();
+    // only while neither side is using the ring
+    void reset();
+    // how a take waits on an empty ring, spins looks before it parks for WAIT_SPIN. set
+    // before the consumer starts
+    void set_wait(wait_mode mode, int spins = 0);
+
+private:
+    bool reserve(int size);
+    bool wait_bytes();
+    void enter();
+    void leave();
+
+private:
+    char* m_buffer;
+    unsigned long long m_capacity;
+    wait_mode m_wait_mode;
+    int m_spins;
+    std::atomic<unsigned long long> m_head, m_tail;
+    std::atomic<bool> m_parked, m_exiting;
+    std::atomic<bool> m_taking, m_growing;
+    std::mutex m_mutex;
+    std::condition_variable m_cond_has_bytes;
+};
+
+#endif
@@ -0,0 +1,379 @@
+/*
+  MIT License
+
+  Copyright (c) 2025 Kong Pengsheng
+
+  Permission is hereby granted, free of charge, to any person obtaining a copy
+  of this software and associated documentation files (the "Software"), to deal
+  in the Software without restriction, including without limitation the rights
+  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+  copies of the Software, and to permit persons to whom the Software is
+  furnished to do so, subject to the following conditions:
+
+  The above copyright notice and this permission notice shall be included in all
+  copies or substantial portions of the Software.
+
+  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+  SOFTWARE.
+*/
+
+#ifndef CO_ENDPOINT_H
+#define CO_ENDPOINT_H
+
+// coroutine layer over the async endpoint operations, compiled only as C++20 or later.
+// awaiting coroutines resume on event loop threads, so a few loops carry any number of them.
+
+#if defined(__cpp_impl_coroutine) && __has_include(<coroutine>)
+
+#include <atomic>
+#include <coroutine>
+#include <deque>
+#include <exception>
+#include <mutex>
+#include <optional>
+#include <string>
+#include "endpoint.h"
+#include "event_loop.h"
+
+template <typename T = void>
+class co_task;
+
+namespace co_detail {
+
+struct promise_base {
+    struct final_awaiter {
+        bool await_ready() const noexcept { return false; }
+
+        template <typename Promise>
+        std::coroutine_handle<> await_suspend(std::coroutine_handle<Promise> handle) noexcept {
+            promise_base& promise = handle.promise();
+            if (promise.detached) {
+                handle.destroy();
+                return std::noop_coroutine();
+            }
+
+            return promise.continuation ? promise.continuation : std::noop_coroutine();
+        }
+
+        void await_resume() const noexcept {}
+    };
+
+    std::coroutine_handle<> continuation;
+    bool detached = false;
+
+    std::suspend_always initial_suspend() const noexcept { return {}; }
+    final_awaiter final_suspend() const noexcept { return {}; }
+    void unhandled_exception() const noexcept { std::terminate(); }
+};
+
+template <typename T>
+struct promise : promise_base {
+    std::optional<T> value;
+
+    co_task<T> get_return_object();
+    void return_value(T v) { value.emplace(std::move(v)); }
+    T result() { return std::move(*value); }
+};
+
+template <>
+struct promise<void> : promise_base {
+    co_task<void> get_return_object();
+    void return_void() const noexcept {}
+    void result() const noexcept {}
+};
+
+// resumes on a fresh loop task, so the notify that completed the operation
+// has returned before the coroutine may disconnect or destroy the endpoint.
+inline void resume_later(std::coroutine_handle<> handle) {
+    event_loop* loop = event_loop::current();
+    if (loop) {
+        loop->post([handle] { handle.resume(); });
+    } else {
+        handle.resume();
+    }
+}
+
+// completion and await_suspend race for the state, the later one resumes or carries on.
+template <typename T>
+class completion_awaiter {
+public:
+    bool await_ready() const noexcept { return false; }
+    T await_resume() { return std::move(m_result); }
+
+protected:
+    void complete(T result) {
+        m_result = std::move(result);
+        if (m_done.exchange(true)) {
+            resume_later(m_handle);
+        }
+    }
+
+    bool suspend(std::coroutine_handle<> handle) {
+        m_handle = handle;
+        return !m_done.exchange(true);
+    }
+
+    T m_result{};
+    std::coroutine_handle<> m_handle;
+    std::atomic<bool> m_done{false};
+};
+
+}
+
+// lazily started, runs when awaited or spawned
+template <typename T>
+class co_task {
+public:
+    using promise_type = co_detail::promise<T>;
+    using handle_type = std::coroutine_handle<promise_type>;
+
+public:
+    explicit co_task(handle_type handle) : m_handle(handle) {}
+    co_task(const co_task&) = delete;
+    co_task(co_task&& other) noexcept : m_handle(other.m_handle) { other.m_handle = nullptr; }
+    ~co_task() {
+        if (m_handle) {
+            m_handle.destroy();
+        }
+    }
+
+    co_task& operator=(const co_task&) = delete;
+    co_task& operator=(co_task&& other) noexcept {
+        std::swap(m_handle, other.m_handle);
+        return *this;
+    }
+
+public:
+    bool await_ready() const noexcept { return !m_handle || m_handle.done(); }
+
+    std::coroutine_handle<> await_suspend(std::coroutine_handle<> continuation) noexcept {
+        m_handle.promise().continuation = continuation;
+        return m_handle;
+    }
+
+    T await_resume() { return m_handle.promise().result(); }
+
+    // starts the task on the calling thread, it frees itself once finished
+    void spawn() {
+        handle_type handle = m_handle;
+        m_handle = nullptr;
+        handle.promise().detached = true;
+        handle.resume();
+    }
+
+private:
+    handle_type m_handle;
+};
+
+template <typename T>
+inline co_task<T> co_detail::promise<T>::get_return_object() {
+    return co_task<T>(co_task<T>::handle_type::from_promise(*this));
+}
+
+inline co_task<void> co_detail::promise<void>::get_return_object() {
+    return co_task<void>(co_task<void>::handle_type::from_promise(*this));
+}
+
+inline void co_spawn(co_task<void>&& task) {
+    task.spawn();
+}
+
+// co_await co_send(ep, ...) gives what send returns. endpoints without async
+// support fall back to the blocking call.
+class co_send : public co_detail::completion_awaiter<int> {
+public:
+    co_send(endpoint* ep, const char* buffer, int size) : m_ep(ep), m_buffer(buffer), m_size(size) {}
+
+    bool await_suspend(std::coroutine_handle<> handle) {
+        if (!m_ep->async_send(m_buffer, m_size, [this](int res) { complete(res); })) {
+            m_result = m_ep->send(m_buffer, m_size);
+            return false;
+        }
+
+        return suspend(handle);
+    }
+
+private:
+    endpoint* m_ep;
+    const char* m_buffer;
+    int m_size;
+};
+
+// co_await co_recv(ep, ...) gives what recv returns
+class co_recv : public co_detail::completion_awaiter<int> {
+public:
+    co_recv(endpoint* ep, char* buffer, int size) : m_ep(ep), m_buffer(buffer), m_size(size) {}
+
+    bool await_suspend(std::coroutine_handle<> handle) {
+        if (!m_ep->async_recv(m_buffer, m_size, [this](int res) { complete(res); })) {
+            m_result = m_ep->recv(m_buffer, m_size);
+            return false;
+        }
+
+        return suspend(handle);
+    }
+
+private:
+    endpoint* m_ep;
+    char* m_buffer;
+    int m_size;
+};
+
+// co_await co_connect(ep, ...) is true once connected, a websocket once its handshake
+// is through, and false when that fails or is disconnected first. endpoints without
+// async_connect fall back to the blocking connect.
+class co_connect : public co_detail::completion_awaiter<bool> {
+public:
+    co_connect(endpoint* ep, const std::string& remote_info) : m_ep(ep), m_remote_info(remote_info) {}
+
+    bool await_suspend(std::coroutine_handle<> handle) {
+        if (!m_ep->async_connect(m_remote_info, [this](int res) { complete(0 < res); })) {
+            m_result = m_ep->connect(m_remote_info, nullptr);
+            return false;
+        }
+
+        return suspend(handle);
+    }
+
+private:
+    endpoint* m_ep;
+    std::string m_remote_info;
+};
+
+inline co_task<bool> co_full_send(endpoint* ep, const char* buffer, int size) {
+    while (0 < size) {
+        int res = co_await co_send(ep, buffer, size);
+        if (res <= 0) {
+            co_return false;
+        }
+
+        buffer += res;
+        size -= res;
+    }
+
+    co_return true;
+}
+
+inline co_task<bool> co_full_recv(endpoint* ep, char* buffer, int size) {
+    while (0 < size) {
+        int res = co_await co_recv(ep, buffer, size);
+        if (res <= 0) {
+            co_return false;
+        }
+
+        buffer += res;
+        size -= res;
+    }
+
+    co_return true;
+}
+
+// serves the endpoint and hands out its sessions to co_await accept(),
+// which gives nullptr once closed. sessions are released with endpoint::destroy.
+class co_acceptor {
+public:
+    explicit co_acceptor(endpoint* ep) : m_ep(ep) {}
+    co_acceptor(const co_acceptor&) = delete;
+    co_acceptor& operator=(const co_acceptor&) = delete;
+    ~co_acceptor() { close(); }
+
+    class accept_awaiter {
+    public:
+        explicit accept_awaiter(co_acceptor* acceptor) : m_acceptor(acceptor) {}
+
+        bool await_ready() const noexcept { return false; }
+
+        bool await_suspend(std::coroutine_handle<> handle) {
+            std::lock_guard<std::mutex> lock(m_acceptor->m_mutex);
+            if (!m_acceptor->m_sessions.empty()) {
+                m_session = m_acceptor->m_sessions.front();
+                m_acceptor->m_sessions.pop_front();
+                return false;
+            }
+
+            if (m_acceptor->m_closed) {
+                return false;
+            }
+
+            m_handle = handle;
+            m_acceptor->m_waiters.push_back(this);
+            return true;
+        }
+
+        endpoint* await_resume() const noexcept { return m_session; }
+
+    private:
+        friend class co_acceptor;
+        co_acceptor* m_acceptor;
+        endpoint* m_session = nullptr;
+        std::coroutine_handle<> m_handle;
+    };
+
+public:
+    bool start() {
+        return m_ep->serve([this](endpoint* session) {
+            accept_awaiter* waiter = nullptr;
+            {
+                std::lock_guard<std::mutex> lock(m_mutex);
+                if (m_closed) {
+                    endpoint::destroy(session);
+                    return;
+                }
+
+                if (m_waiters.empty()) {
+                    m_sessions.push_back(session);
+                    return;
+                }
+
+                waiter = m_waiters.front();
+                m_waiters.pop_front();
+            }
+
+            waiter->m_session = session;
+            co_detail::resume_later(waiter->m_handle);
+        });
+    }
+
+    accept_awaiter accept() { return accept_awaiter(this); }
+
+    // stops handing out sessions, pending accepts get nullptr
+    void close() {
+        std::deque<accept_awaiter*> waiters;
+        std::deque<endpoint*> sessions;
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            if (m_closed) {
+                return;
+            }
+
+            m_closed = true;
+            waiters.swap(m_waiters);
+            sessions.swap(m_sessions);
+        }
+
+        m_ep->close();
+        for (endpoint* session : sessions) {
+            endpoint::destroy(session);
+        }
+
+        for (accept_awaiter* waiter : waiters) {
+            co_detail::resume_later(waiter->m_handle);
+        }
+    }
+
+private:
+    endpoint* m_ep;
+    std::mutex m_mutex;
+    std::deque<endpoint*> m_sessions;
+    std::deque<accept_awaiter*> m_waiters;
+    bool m_closed = false;
+};
+
+#endif
+
+#endif
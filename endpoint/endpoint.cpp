@@ -26,6 +26,11 @@
 #include "bluetooth.h"
 #include "tcp.h"
 #include "websocket.h"
+#include "unix_domain.h"
+#include "shm.h"
+#include "udp.h"
+#include "inproc.h"
+#include "netsim.h"
 
 using namespace std::placeholders;
 
@@ -56,6 +61,16 @@ endpoint* endpoint::create(endpoint_type type, const std::string& info) {
         return new tcp(info);
     case WEBSOCKET:
         return new websocket(info);
+    case UNIX:
+        return new unix_domain(info);
+    case SHM:
+        return new shm(info);
+    case UDP:
+        return new udp(info);
+    case INPROC:
+        return new inproc(info);
+    case NETSIM:
+        return new netsim(info);
     }
 
     return nullptr;
@@ -65,6 +80,54 @@ void endpoint::destroy(endpoint* ep) {
     delete ep;
 }
 
+int endpoint::sendv(const const_buffer* buffers, int count) {
+    int size = 0;
+    for (int i = 0; buffers && i < count; ++i) {
+        if (!buffers[i].data || buffers[i].size <= 0) {
+            continue;
+        }
+
+        int res = send(buffers[i].data, buffers[i].size);
+        if (res <= 0) {
+            return res;
+        }
+
+        size += res;
+    }
+
+    return size;
+}
+
+int endpoint::recvv(const mutable_buffer* buffers, int count) {
+    for (int i = 0; buffers && i < count; ++i) {
+        if (buffers[i].data && 0 < buffers[i].size) {
+            return recv(buffers[i].data, buffers[i].size);
+        }
+    }
+
+    return 0;
+}
+
+bool endpoint::async_send(const char* buffer, int size, completion_notify notify) {
+    return false;
+}
+
+bool endpoint::async_recv(char* buffer, int size, completion_notify notify) {
+    return false;
+}
+
+bool endpoint::async_connect(const std::string& remote_info, completion_notify notify) {
+    return false;
+}
+
+bool endpoint::serve(session_notify notify) {
+    return false;
+}
+
+bool endpoint::set_option(endpoint_option option, int value) {
+    return false;
+}
+
 bool endpoint::full_send(const char* buffer, int size) {
     return full_trans(buffer, size, std::bind(&endpoint::send, this, _1, _2));
 }
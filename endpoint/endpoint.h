@@ -33,10 +33,52 @@ public:
     enum endpoint_type {
         BLUETOOTH,
         TCP,
-        WEBSOCKET
+        WEBSOCKET,
+        UNIX,
+        SHM,
+        UDP,
+        INPROC,
+        NETSIM
+    };
+
+    enum endpoint_option {
+        OPTION_BACKEND,
+        OPTION_SHARDS,
+        OPTION_PIN_CORES,
+        OPTION_SEQPACKET,
+        OPTION_RING_SIZE,
+        OPTION_SPIN,
+        OPTION_GRO,
+        OPTION_DELAY,
+        OPTION_JITTER,
+        OPTION_RATE,
+        OPTION_CHUNK,
+        OPTION_LOSS,
+        OPTION_REORDER,
+        OPTION_FLUSH_SIZE,
+        OPTION_FLUSH_DELAY,
+        OPTION_WAIT,
+        OPTION_MESSAGES
+    };
+
+    enum endpoint_backend {
+        BACKEND_SOCKET,
+        BACKEND_IO_URING
+    };
+
+    struct const_buffer {
+        const char* data;
+        int size;
+    };
+
+    struct mutable_buffer {
+        char* data;
+        int size;
     };
 
     using connected_notify = std::function<void()>;
+    using session_notify = std::function<void(endpoint* session)>;
+    using completion_notify = std::function<void(int res)>;
 
 public:
     static endpoint* create(endpoint_type type, const std::string& info = std::string());
@@ -61,6 +103,46 @@ public:
     virtual int send(const char* buffer, int size) = 0;
     virtual int recv(char* buffer, int size) = 0;
 
+    // gathers the buffers into one send, all or nothing like send.
+    virtual int sendv(const const_buffer* buffers, int count);
+    // scatters one read over the buffers in order, returns what recv would.
+    virtual int recvv(const mutable_buffer* buffers, int count);
+
+    // start a send or recv and return at once, false if not supported. notify gets
+    // what send or recv would have returned, on an event loop thread. async_send
+    // copies the bytes, the buffer of async_recv must stay valid until notified.
+    virtual bool async_send(const char* buffer, int size, completion_notify notify);
+    virtual bool async_recv(char* buffer, int size, completion_notify notify);
+    // connect without waiting, notify gets 1 once connected and 0 when it failed or
+    // disconnect cut it short. a websocket is connected once its handshake is through.
+    virtual bool async_connect(const std::string& remote_info, completion_notify notify);
+
+    // accepts any number of peers, each one handed over as a connected
+    // session endpoint owned by the caller and released with destroy.
+    virtual bool serve(session_notify notify);
+
+    // set before listen, serve or connect; sessions take the options of their listener.
+    // BACKEND_IO_URING quietly keeps the socket backend where io_uring is not available.
+    // OPTION_SHARDS splits serve over that many SO_REUSEPORT listeners, each with a loop
+    // of its own running accept and session io, OPTION_PIN_CORES pins those loops to cores.
+    // without SO_REUSEPORT serve keeps a single listener.
+    // OPTION_SEQPACKET makes a UNIX endpoint keep message boundaries, linux only.
+    // OPTION_RING_SIZE gives the bytes of each direction of SHM, the listening side decides.
+    // OPTION_SPIN is how many microseconds a waiting SHM send or recv spins before it sleeps.
+    // OPTION_GRO lets UDP take a run of datagrams in one receive, recv still hands them out
+    // one by one. linux only, quietly off where the kernel lacks it.
+    // OPTION_DELAY to OPTION_REORDER set the link of NETSIM, conditions in info win.
+    // OPTION_FLUSH_SIZE and OPTION_FLUSH_DELAY make tcp and unix streams gather sends from
+    // any number of threads and write them together once that many bytes wait or that many
+    // microseconds passed, a send then returns as soon as its bytes are queued. with a size
+    // alone the rest goes on the next turn of the loop. both 0, the default, send at once.
+    // OPTION_WAIT is how a WEBSOCKET recv waits for the loop to hand bytes over: 0, the
+    // default, sleeps at once, a count looks that many times with a pause in between before
+    // it sleeps, -1 never sleeps and keeps a core busy.
+    // OPTION_MESSAGES makes a WEBSOCKET keep message boundaries, recv and async_recv hand
+    // out one whole message each, cut to the buffer, and empty messages are skipped.
+    virtual bool set_option(endpoint_option option, int value);
+
 public:
     const std::string& info() const { return m_info; }
     const std::string& remote_info() const { return m_remote_info; }
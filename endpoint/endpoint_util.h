@@ -0,0 +1,52 @@
+/*
+  MIT License
+
+  Copyright (c) 2025 Kong Pengsheng
+
+  Permission is hereby granted, free of charge, to any person obtaining a copy
+  of this software and associated documentation files (the "Software"), to deal
+  in the Software without restriction, including without limitation the rights
+  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+  copies of the Software, and to permit persons to whom the Software is
+  furnished to do so, subject to the following conditions:
+
+  The above copyright notice and this permission notice shall be included in all
+  copies or substantial portions of the Software.
+
+  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+  SOFTWARE.
+*/
+
+#ifndef ENDPOINT_UTIL_H
+#define ENDPOINT_UTIL_H
+
+#include "endpoint.h"
+
+// an async_recv waiting for bytes, the buffer is the caller's again once notified
+struct recv_request {
+    char* buffer;
+    int size;
+    endpoint::completion_notify notify;
+};
+
+// a buffer of sendv or recvv without data counts as empty
+template<class buffer_t>
+inline int buffer_size(const buffer_t& buffer) {
+    return buffer.data && 0 < buffer.size ? buffer.size : 0;
+}
+
+template<class buffer_t>
+inline int total_size(const buffer_t* buffers, int count) {
+    int size = 0;
+    for (int i = 0; buffers && i < count; ++i) {
+        size += buffer_size(buffers[i]);
+    }
+    return size;
+}
+
+#endif
@@ -0,0 +1,550 @@
+/*
+  MIT License
+
+  Copyright (c) 2025 Kong Pengsheng
+
+  Permission is hereby granted, free of charge, to any person obtaining a copy
+  of this software and associated documentation files (the "Software"), to deal
+  in the Software without restriction, including without limitation the rights
+  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+  copies of the Software, and to permit persons to whom the Software is
+  furnished to do so, subject to the following conditions:
+
+  The above copyright notice and this permission notice shall be included in all
+  copies or substantial portions of the Software.
+
+  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+  SOFTWARE.
+*/
+
+#include "event_loop.h"
+#include <algorithm>
+#include <map>
+#include <unordered_map>
+#include <vector>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <atomic>
+#include <tuple>
+#include <future>
+
+struct poll_event {
+    unsigned long long id;
+    unsigned events;
+    bool completed;
+    event_loop::io_completion completion;
+    int res;
+    char* buffer;
+    unsigned tag;
+};
+
+class poller {
+public:
+    static const unsigned long long WAKE_ID = 0;
+
+public:
+    virtual ~poller() {}
+
+    virtual bool open() = 0;
+    virtual void close() = 0;
+    virtual bool add(socket_t fd, unsigned long long id, unsigned events) = 0;
+    virtual bool modify(socket_t fd, unsigned long long id, unsigned events) = 0;
+    virtual void remove(socket_t fd, unsigned long long id) = 0;
+    virtual int wait(poll_event* events, int max_count, int timeout) = 0;
+    virtual void wake() = 0;
+
+    virtual bool accept(socket_t fd, unsigned long long id) { return false; }
+    virtual bool receive(socket_t fd, unsigned long long id, bool start) { return false; }
+    virtual bool send(socket_t fd, unsigned long long id, std::string&& buffer) { return false; }
+    // hands back whatever the event borrowed once its handler returned
+    virtual void release(const poll_event& event) {}
+};
+
+#if defined K_WINDOWS
+#include "event_loop_windows.impl"
+using platform_poller = wsapoll_poller;
+#elif defined K_LINUX
+#include "event_loop_linux.impl"
+using platform_poller = epoll_poller;
+#if defined __has_include
+#if __has_include(<linux/io_uring.h>)
+#include "event_loop_uring.impl"
+#endif
+#endif
+#endif
+
+const int MAX_POLL_EVENTS = 256;
+const unsigned MAX_POOL_SIZE = 4;
+
+using steady_clock = std::chrono::steady_clock;
+
+struct handler_entry {
+    std::mutex mutex;
+    bool removed = false;
+};
+
+struct io_entry : handler_entry {
+    socket_t fd = INVALID_SOCKET;
+    event_loop::io_handler handler;
+    event_loop::completion_handler on_completion;
+};
+
+struct timer_entry : handler_entry {
+    event_loop::task handler;
+    std::chrono::microseconds interval;
+    bool repeat = false;
+};
+
+struct event_loop_data {
+    std::unique_ptr<poller> poll;
+    event_loop::loop_backend backend = event_loop::BACKEND_POLL;
+    bool opened = false;
+    int core = -1;
+    std::thread thread;
+    std::atomic<std::thread::id> thread_id;
+    std::atomic<bool> running;
+    std::atomic<bool> waking;
+    std::mutex mutex;
+    unsigned long long last_id = poller::WAKE_ID;
+    std::unordered_map<unsigned long long, std::shared_ptr<io_entry>> ios;
+    std::unordered_map<socket_t, unsigned long long> fds;
+    std::unordered_map<event_loop::timer_id, std::shared_ptr<timer_entry>> timers;
+    std::multimap<steady_clock::time_point, event_loop::timer_id> deadlines;
+    std::vector<event_loop::task> tasks;
+    // swapped with tasks to run them, both keep their capacity
+    std::vector<event_loop::task> running_tasks;
+
+    event_loop_data() : thread_id(std::thread::id()), running(false), waking(false) {}
+};
+
+static thread_local event_loop* current_loop = nullptr;
+
+template<class entry_t, class... arguments>
+static void invoke(const std::shared_ptr<entry_t>& entry, arguments... args) {
+    std::lock_guard<std::mutex> lock(entry->mutex);
+    if (!entry->removed) {
+        entry->handler(args...);
+    }
+}
+
+static void complete(const std::shared_ptr<io_entry>& entry, const poll_event& event) {
+    std::lock_guard<std::mutex> lock(entry->mutex);
+    if (!entry->removed && entry->on_completion) {
+        entry->on_completion(event.completion, event.res, event.buffer);
+    }
+}
+
+template<class entry_t>
+static void retire(const std::shared_ptr<entry_t>& entry, bool in_loop_thread) {
+    if (in_loop_thread) {
+        entry->removed = true;
+    } else {
+        std::lock_guard<std::mutex> lock(entry->mutex);
+        entry->removed = true;
+    }
+}
+
+static bool attach_entry(event_loop_data* data, const std::shared_ptr<io_entry>& entry, unsigned events) {
+    std::lock_guard<std::mutex> lock(data->mutex);
+    if (data->fds.count(entry->fd)) {
+        return false;
+    }
+
+    unsigned long long id = ++data->last_id;
+    if (!data->poll->add(entry->fd, id, events)) {
+        return false;
+    }
+
+    data->ios[id] = entry;
+    data->fds[entry->fd] = id;
+    return true;
+}
+
+event_loop* event_loop::pick(loop_backend backend) {
+    struct loop_pool {
+        std::vector<event_loop*> loops;
+        std::atomic<unsigned> next;
+
+        loop_pool(loop_backend backend) : next(0) {
+            unsigned count = std::max(1u, std::min(std::thread::hardware_concurrency(), MAX_POOL_SIZE));
+            for (unsigned i = 0; i < count; ++i) {
+                event_loop* loop = new event_loop(backend);
+                if (loop->backend() != backend) {
+                    delete loop;
+                    break;
+                }
+
+                loop->start();
+                loops.push_back(loop);
+            }
+        }
+
+        event_loop* next_loop() {
+            return loops[next++ % loops.size()];
+        }
+    };
+
+    if (BACKEND_IO_URING == backend) {
+        static loop_pool* uring_pool = new loop_pool(BACKEND_IO_URING);
+        if (!uring_pool->loops.empty()) {
+            return uring_pool->next_loop();
+        }
+    }
+
+    static loop_pool* poll_pool = new loop_pool(BACKEND_POLL);
+    return poll_pool->next_loop();
+}
+
+event_loop* event_loop::shard(unsigned index, loop_backend backend, bool pinned) {
+    static std::mutex mutex;
+    static std::map<std::tuple<loop_backend, unsigned, bool>, event_loop*>* shards =
+        new std::map<std::tuple<loop_backend, unsigned, bool>, event_loop*>;
+
+    unsigned cores = std::max(1u, std::thread::hardware_concurrency());
+    std::lock_guard<std::mutex> lock(mutex);
+    event_loop*& loop = (*shards)[std::make_tuple(backend, index, pinned)];
+    if (!loop) {
+        loop = new event_loop(backend);
+        loop->m_data->core = pinned ? (int)(index % cores) : -1;
+        loop->start();
+    }
+
+    return loop;
+}
+
+event_loop* event_loop::current() {
+    return current_loop;
+}
+
+event_loop::event_loop(loop_backend backend) : m_data(new event_loop_data) {
+    socket_data::init();
+#if defined K_IO_URING
+    if (BACKEND_IO_URING == backend) {
+        m_data->poll.reset(new uring_poller);
+        m_data->opened = m_data->poll->open();
+        if (m_data->opened) {
+            m_data->backend = BACKEND_IO_URING;
+            return;
+        }
+    }
+#endif
+
+    m_data->poll.reset(new platform_poller);
+    m_data->opened = m_data->poll->open();
+}
+
+event_loop::~event_loop() {
+    stop();
+    if (m_data->opened) {
+        m_data->poll->close();
+    }
+    delete m_data;
+}
+
+bool event_loop::start() {
+    if (!m_data->opened) {
+        return false;
+    }
+
+    if (m_data->running.exchange(true)) {
+        return true;
+    }
+
+    m_data->thread = std::thread(&event_loop::run, this);
+    return true;
+}
+
+void event_loop::stop() {
+    if (!m_data->running.exchange(false)) {
+        return;
+    }
+
+    m_data->poll->wake();
+    if (m_data->thread.joinable()) {
+        if (in_loop_thread()) {
+            m_data->thread.detach();
+        } else {
+            m_data->thread.join();
+        }
+    }
+}
+
+bool event_loop::is_running() const {
+    return m_data->running;
+}
+
+bool event_loop::in_loop_thread() const {
+    return std::this_thread::get_id() == m_data->thread_id.load();
+}
+
+event_loop::loop_backend event_loop::backend() const {
+    return m_data->backend;
+}
+
+bool event_loop::attach(socket_t fd, unsigned events, io_handler handler) {
+    if (INVALID_SOCKET == fd || !handler) {
+        return false;
+    }
+
+    std::shared_ptr<io_entry> entry = std::make_shared<io_entry>();
+    entry->fd = fd;
+    entry->handler = handler;
+    return attach_entry(m_data, entry, events);
+}
+
+bool event_loop::attach(socket_t fd, completion_handler handler) {
+    if (INVALID_SOCKET == fd || !handler || BACKEND_IO_URING != m_data->backend) {
+        return false;
+    }
+
+    std::shared_ptr<io_entry> entry = std::make_shared<io_entry>();
+    entry->fd = fd;
+    entry->on_completion = handler;
+    return attach_entry(m_data, entry, IO_NONE);
+}
+
+bool event_loop::modify(socket_t fd, unsigned events) {
+    std::lock_guard<std::mutex> lock(m_data->mutex);
+    auto it = m_data->fds.find(fd);
+    if (m_data->fds.end() == it) {
+        return false;
+    }
+
+    return m_data->poll->modify(fd, it->second, events);
+}
+
+void event_loop::detach(socket_t fd) {
+    std::shared_ptr<io_entry> entry;
+    {
+        std::lock_guard<std::mutex> lock(m_data->mutex);
+        auto it = m_data->fds.find(fd);
+        if (m_data->fds.end() == it) {
+            return;
+        }
+
+        auto io_it = m_data->ios.find(it->second);
+        entry = io_it->second;
+        m_data->ios.erase(io_it);
+        m_data->poll->remove(fd, it->second);
+        m_data->fds.erase(it);
+    }
+
+    retire(entry, in_loop_thread());
+}
+
+bool event_loop::accept(socket_t fd) {
+    std::lock_guard<std::mutex> lock(m_data->mutex);
+    auto it = m_data->fds.find(fd);
+    return m_data->fds.end() != it && m_data->poll->accept(fd, it->second);
+}
+
+bool event_loop::receive(socket_t fd, bool start) {
+    std::lock_guard<std::mutex> lock(m_data->mutex);
+    auto it = m_data->fds.find(fd);
+    return m_data->fds.end() != it && m_data->poll->receive(fd, it->second, start);
+}
+
+bool event_loop::send(socket_t fd, std::string&& buffer) {
+    std::lock_guard<std::mutex> lock(m_data->mutex);
+    auto it = m_data->fds.find(fd);
+    return m_data->fds.end() != it && m_data->poll->send(fd, it->second, std::move(buffer));
+}
+
+void event_loop::post(task t) {
+    if (!t) {
+        return;
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(m_data->mutex);
+        m_data->tasks.push_back(std::move(t));
+    }
+
+    wake();
+}
+
+void event_loop::sync(task t) {
+    if (in_loop_thread() || !is_running()) {
+        t();
+        return;
+    }
+
+    if (current()) {
+        post(std::move(t));
+        return;
+    }
+
+    std::promise<void> passed;
+    post([&passed, &t] {
+        t();
+        passed.set_value();
+    });
+    passed.get_future().wait();
+}
+
+event_loop::timer_id event_loop::add_timer(std::chrono::microseconds interval, task t, bool repeat) {
+    if (!t) {
+        return 0;
+    }
+
+    std::shared_ptr<timer_entry> entry = std::make_shared<timer_entry>();
+    entry->handler = t;
+    entry->interval = interval;
+    entry->repeat = repeat;
+
+    timer_id id = 0;
+    bool first = false;
+    {
+        std::lock_guard<std::mutex> lock(m_data->mutex);
+        id = ++m_data->last_id;
+        m_data->timers[id] = entry;
+        auto it = m_data->deadlines.emplace(steady_clock::now() + interval, id);
+        first = m_data->deadlines.begin() == it;
+    }
+
+    if (first) {
+        wake();
+    }
+
+    return id;
+}
+
+void event_loop::cancel_timer(timer_id id) {
+    std::shared_ptr<timer_entry> entry;
+    {
+        std::lock_guard<std::mutex> lock(m_data->mutex);
+        auto it = m_data->timers.find(id);
+        if (m_data->timers.end() == it) {
+            return;
+        }
+
+        entry = it->second;
+        m_data->timers.erase(it);
+    }
+
+    retire(entry, in_loop_thread());
+}
+
+void event_loop::run() {
+    m_data->thread_id = std::this_thread::get_id();
+    current_loop = this;
+    if (0 <= m_data->core) {
+        pin_thread((unsigned)m_data->core);
+    }
+
+    std::vector<poll_event> events(MAX_POLL_EVENTS);
+    std::vector<std::shared_ptr<io_entry>> entries;
+    while (m_data->running) {
+        int count = m_data->poll->wait(events.data(), MAX_POLL_EVENTS, next_timeout());
+        m_data->waking = false;
+
+        {
+            std::lock_guard<std::mutex> lock(m_data->mutex);
+            for (int i = 0; i < count; ++i) {
+                auto it = m_data->ios.find(events[i].id);
+                entries.push_back(m_data->ios.end() != it ? it->second : nullptr);
+            }
+        }
+
+        for (int i = 0; i < count; ++i) {
+            const poll_event& event = events[i];
+            if (!event.completed) {
+                if (entries[i]) {
+                    invoke(entries[i], event.events);
+                }
+            } else if (entries[i]) {
+                complete(entries[i], event);
+            } else if (IO_ACCEPTED == event.completion) {
+                closesocket((socket_t)event.res);
+            }
+            m_data->poll->release(event);
+        }
+        entries.clear();
+
+        run_timers();
+        run_tasks();
+    }
+
+    m_data->thread_id = std::thread::id();
+    current_loop = nullptr;
+}
+
+int event_loop::next_timeout() {
+    std::lock_guard<std::mutex> lock(m_data->mutex);
+    if (!m_data->tasks.empty()) {
+        return 0;
+    }
+
+    if (m_data->deadlines.empty()) {
+        return -1;
+    }
+
+    auto remain = m_data->deadlines.begin()->first - steady_clock::now();
+    if (remain <= steady_clock::duration::zero()) {
+        return 0;
+    }
+
+    auto timeout = std::chrono::duration_cast<std::chrono::milliseconds>(remain);
+    if (timeout < remain) {
+        timeout += std::chrono::milliseconds(1);
+    }
+
+    return (int)timeout.count();
+}
+
+void event_loop::run_timers() {
+    steady_clock::time_point now = steady_clock::now();
+    while (true) {
+        std::shared_ptr<timer_entry> entry;
+        timer_id id = 0;
+        {
+            std::lock_guard<std::mutex> lock(m_data->mutex);
+            auto it = m_data->deadlines.begin();
+            if (m_data->deadlines.end() == it || now < it->first) {
+                break;
+            }
+
+            id = it->second;
+            m_data->deadlines.erase(it);
+            auto timer_it = m_data->timers.find(id);
+            if (m_data->timers.end() == timer_it) {
+                continue;
+            }
+
+            entry = timer_it->second;
+            if (entry->repeat) {
+                m_data->deadlines.emplace(now + std::max(entry->interval, std::chrono::microseconds(1)), id);
+            } else {
+                m_data->timers.erase(timer_it);
+            }
+        }
+
+        invoke(entry);
+    }
+}
+
+void event_loop::run_tasks() {
+    std::vector<task>& tasks = m_data->running_tasks;
+    {
+        std::lock_guard<std::mutex> lock(m_data->mutex);
+        tasks.swap(m_data->tasks);
+    }
+
+    for (task& t : tasks) {
+        t();
+    }
+
+    tasks.clear();
+}
+
+void event_loop::wake() {
+    if (!in_loop_thread() && !m_data->waking.exchange(true)) {
+        m_data->poll->wake();
+    }
+}
@@ -0,0 +1,118 @@
+/*
+  MIT License
+
+  Copyright (c) 2025 Kong Pengsheng
+
+  Permission is hereby granted, free of charge, to any person obtaining a copy
+  of this software and associated documentation files (the "Software"), to deal
+  in the Software without restriction, including without limitation the rights
+  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+  copies of the Software, and to permit persons to whom the Software is
+  furnished to do so, subject to the following conditions:
+
+  The above copyright notice and this permission notice shall be included in all
+  copies or substantial portions of the Software.
+
+  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+  SOFTWARE.
+*/
+
+#ifndef EVENT_LOOP_H
+#define EVENT_LOOP_H
+
+#include <functional>
+#include <chrono>
+#include <string>
+#include "socket.h"
+
+class event_loop {
+public:
+    enum io_event : unsigned {
+        IO_NONE     = 0,
+        IO_READ     = 1 << 0,
+        IO_WRITE    = 1 << 1,
+        IO_ERROR    = 1 << 2
+    };
+
+    enum loop_backend {
+        BACKEND_POLL,
+        BACKEND_IO_URING
+    };
+
+    enum io_completion {
+        IO_ACCEPTED,
+        IO_RECEIVED,
+        IO_SENT
+    };
+
+    using io_handler = std::function<void(unsigned events)>;
+    using completion_handler = std::function<void(io_completion completion, int res, char* buffer)>;
+    using task = std::function<void()>;
+    using timer_id = unsigned long long;
+
+public:
+    // shared loops driving every endpoint, handed out round-robin
+    // falls back to the poll loops when io_uring is not available
+    static event_loop* pick(loop_backend backend = BACKEND_POLL);
+    // loop of its own for listener shard index, the thread pinned to core index % cores
+    // when asked. shards live as long as the process, like the shared loops.
+    static event_loop* shard(unsigned index, loop_backend backend = BACKEND_POLL, bool pinned = false);
+    // loop running on the calling thread, nullptr outside of loop threads
+    static event_loop* current();
+
+public:
+    explicit event_loop(loop_backend backend = BACKEND_POLL);
+    event_loop(const event_loop&) = delete;
+    event_loop(event_loop&&) = delete;
+    ~event_loop();
+
+    event_loop& operator=(const event_loop&) = delete;
+    event_loop& operator=(event_loop&&) = delete;
+
+public:
+    bool start();
+    void stop();
+    bool is_running() const;
+    bool in_loop_thread() const;
+    loop_backend backend() const;
+
+    // events are level triggered, the handler runs on the loop thread.
+    // once detach returns, the handler of fd is not running and never runs again.
+    bool attach(socket_t fd, unsigned events, io_handler handler);
+    bool modify(socket_t fd, unsigned events);
+    void detach(socket_t fd);
+
+    // completion based io on io_uring loops, the handler runs on the loop thread with the
+    // accepted socket, the received bytes or the sent size; res <= 0 reports eof or errors.
+    // the received bytes may be written over in place until the handler returns.
+    // one send may be in flight per fd, it completes only when the whole buffer is sent.
+    bool attach(socket_t fd, completion_handler handler);
+    bool accept(socket_t fd);
+    bool receive(socket_t fd, bool start = true);
+    bool send(socket_t fd, std::string&& buffer);
+
+    void post(task t);
+    // runs t after everything posted before it: at once on the loop thread or when the
+    // loop is not running, waited for from a plain thread. from another loop it is only
+    // posted, two loops waiting on each other would hang
+    void sync(task t);
+    timer_id add_timer(std::chrono::microseconds interval, task t, bool repeat = false);
+    void cancel_timer(timer_id id);
+
+private:
+    void run();
+    int next_timeout();
+    void run_timers();
+    void run_tasks();
+    void wake();
+
+private:
+    struct event_loop_data* m_data;
+};
+
+#endif
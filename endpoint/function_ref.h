@@ -0,0 +1,68 @@
+/*
+  MIT License
+
+  Copyright (c) 2025 Kong Pengsheng
+
+  Permission is hereby granted, free of charge, to any person obtaining a copy
+  of this software and associated documentation files (the "Software"), to deal
+  in the Software without restriction, including without limitation the rights
+  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+  copies of the Software, and to permit persons to whom the Software is
+  furnished to do so, subject to the following conditions:
+
+  The above copyright notice and this permission notice shall be included in all
+  copies or substantial portions of the Software.
+
+  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+  SOFTWARE.
+*/
+
+#ifndef FUNCTION_REF_H
+#define FUNCTION_REF_H
+
+#include <cstddef>
+#include <memory>
+#include <type_traits>
+#include <utility>
+
+// a callable handed down to be called before the call that takes it returns, and never
+// kept. it only points at the callable, so unlike std::function nothing is copied or
+// allocated, and a lambda or bind result made in the argument list lives long enough.
+template<class signature>
+class function_ref;
+
+template<class result, class... arguments>
+class function_ref<result(arguments...)> {
+public:
+    function_ref() = default;
+    function_ref(std::nullptr_t) {}
+
+    template<class callable,
+             class = typename std::enable_if<!std::is_same<typename std::decay<callable>::type, function_ref>::value>::type>
+    function_ref(callable&& func)
+        : m_object((void*)std::addressof(func)),
+          m_invoke(&invoke<typename std::remove_reference<callable>::type>) {}
+
+    explicit operator bool() const { return nullptr != m_invoke; }
+
+    result operator()(arguments... args) const {
+        return m_invoke(m_object, std::forward<arguments>(args)...);
+    }
+
+private:
+    template<class callable>
+    static result invoke(void* object, arguments... args) {
+        return (*(callable*)object)(std::forward<arguments>(args)...);
+    }
+
+private:
+    void* m_object = nullptr;
+    result (*m_invoke)(void* object, arguments... args) = nullptr;
+};
+
+#endif
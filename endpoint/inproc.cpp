@@ -0,0 +1,507 @@
+/*
+  MIT License
+
+  Copyright (c) 2025 Kong Pengsheng
+
+  Permission is hereby granted, free of charge, to any person obtaining a copy
+  of this software and associated documentation files (the "Software"), to deal
+  in the Software without restriction, including without limitation the rights
+  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+  copies of the Software, and to permit persons to whom the Software is
+  furnished to do so, subject to the following conditions:
+
+  The above copyright notice and this permission notice shall be included in all
+  copies or substantial portions of the Software.
+
+  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+  SOFTWARE.
+*/
+
+#include "inproc.h"
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <map>
+#include <mutex>
+#include <vector>
+#include "byte_queue.h"
+#include "endpoint_util.h"
+#include "event_loop.h"
+
+const int INPUT_BUFFER_SIZE = 1024 * 64;
+// unread bytes a bounded send leaves room for, as in a tcp input queue
+const int INPUT_QUEUE_LIMIT = 1024 * 1024 * 4;
+
+// the bytes sent to one end, taken by recv or pushed by its loop
+struct inproc_side {
+    event_loop* loop = nullptr;
+    byte_queue input;
+    tcp::input_notify on_input;
+    std::deque<recv_request> recv_requests;
+    // the pipe holds itself while a delivery is posted, the task only has the pointer
+    std::shared_ptr<inproc_pipe> delivering_pipe;
+    bool delivering = false;
+    // held while the input notify runs, like an io handler under its entry
+    std::mutex notify_mutex;
+    bool close_pushed = false;
+    int recv_waiters = 0;
+    int send_waiters = 0;
+};
+
+struct inproc_pipe {
+    std::mutex mutex;
+    std::condition_variable cond;
+    bool closed = false;
+    inproc_side sides[2];
+};
+
+struct inproc_data {
+    event_loop* loop = nullptr;
+    std::mutex mutex;
+    std::shared_ptr<inproc_pipe> pipe;
+    int side = 0;
+    bool listening = false;
+    endpoint::connected_notify on_connected;
+    endpoint::session_notify on_session;
+};
+
+// listening and serving endpoints by name, connect looks them up under the lock
+static std::mutex registry_mutex;
+static std::map<std::string, inproc*> registry;
+static std::atomic<unsigned> connect_count(0);
+
+static void deliver(inproc_pipe* pipe, int index);
+
+// senders waiting for room hear of it once the input is taken below the limit
+static void wake_senders(inproc_pipe* pipe, const inproc_side& side) {
+    if (side.send_waiters && side.input.size() < INPUT_QUEUE_LIMIT) {
+        pipe->cond.notify_all();
+    }
+}
+
+// pushed input and async receives run on the loop of the side, one delivery at a time
+static void schedule(const std::shared_ptr<inproc_pipe>& pipe, int index) {
+    inproc_side& side = pipe->sides[index];
+    if (side.recv_waiters) {
+        pipe->cond.notify_all();
+    }
+
+    if (side.delivering || !side.loop || (!side.on_input && side.recv_requests.empty())) {
+        return;
+    }
+
+    // two plain values std::function keeps in place, no allocation per delivery
+    side.delivering = true;
+    side.delivering_pipe = pipe;
+    inproc_pipe* target = pipe.get();
+    side.loop->post([target, index] { deliver(target, index); });
+}
+
+static void deliver(inproc_pipe* pipe, int index) {
+    static thread_local char buffer[INPUT_BUFFER_SIZE];
+
+    inproc_side& side = pipe->sides[index];
+    std::shared_ptr<inproc_pipe> holding;
+    std::vector<event_loop::task> done;
+    while (true) {
+        tcp::input_notify notify;
+        int size = 0;
+        {
+            std::lock_guard<std::mutex> lock(pipe->mutex);
+            while (!side.recv_requests.empty() && (side.input.size() || pipe->closed)) {
+                recv_request& request = side.recv_requests.front();
+                int res = side.input.take(request.buffer, request.size, false);
+                done.push_back(std::bind(request.notify, res));
+                side.recv_requests.pop_front();
+            }
+
+            wake_senders(pipe, side);
+            notify = side.on_input;
+            if (notify && side.input.size()) {
+                size = side.input.take(buffer, INPUT_BUFFER_SIZE, false);
+                wake_senders(pipe, side);
+            } else if (notify && pipe->closed && !side.close_pushed) {
+                side.close_pushed = true;
+            } else {
+                side.delivering = false;
+                holding.swap(side.delivering_pipe);
+                break;
+            }
+        }
+
+        std::lock_guard<std::mutex> notifying(side.notify_mutex);
+        notify(buffer, size);
+    }
+
+    for (event_loop::task& t : done) {
+        t();
+    }
+}
+
+inproc::inproc(const std::string& info) : tcp(info), m_data(new inproc_data) {
+    m_data->loop = event_loop::pick();
+}
+
+inproc::~inproc() {
+    // disconnect waited out a delivery running on the loop, posted ones hold the pipe
+    close();
+    delete m_data;
+}
+
+bool inproc::listen(connected_notify notify) {
+    return register_name(notify, nullptr);
+}
+
+bool inproc::connect(const std::string& remote_info, connected_notify notify) {
+    disconnect();
+    if (m_info.empty()) {
+        m_info = "inproc-" + std::to_string(++connect_count);
+    }
+
+    std::shared_ptr<inproc_pipe> pipe = std::make_shared<inproc_pipe>();
+    attach_pipe(pipe, 0);
+    {
+        std::lock_guard<std::mutex> lock(registry_mutex);
+        auto it = registry.find(remote_info);
+        if (registry.end() == it || !it->second->accept_pipe(pipe, m_info)) {
+            disconnect();
+            return false;
+        }
+    }
+
+    m_remote_info = remote_info;
+
+    if (notify) {
+        notify();
+    }
+
+    return true;
+}
+
+bool inproc::is_listening() const {
+    std::lock_guard<std::mutex> lock(m_data->mutex);
+    return m_data->listening;
+}
+
+bool inproc::is_connected() const {
+    std::shared_ptr<inproc_pipe> pipe;
+    {
+        std::lock_guard<std::mutex> lock(m_data->mutex);
+        pipe = m_data->pipe;
+    }
+
+    if (!pipe) {
+        return false;
+    }
+
+    std::lock_guard<std::mutex> lock(pipe->mutex);
+    return !pipe->closed;
+}
+
+void inproc::disconnect() {
+    std::shared_ptr<inproc_pipe> pipe;
+    int index = 0;
+    {
+        std::lock_guard<std::mutex> lock(m_data->mutex);
+        pipe.swap(m_data->pipe);
+        index = m_data->side;
+    }
+
+    if (!pipe) {
+        return;
+    }
+
+    std::deque<recv_request> recv_requests;
+    {
+        std::lock_guard<std::mutex> lock(pipe->mutex);
+        pipe->closed = true;
+        pipe->sides[index].on_input = nullptr;
+        pipe->sides[index].recv_requests.swap(recv_requests);
+        pipe->cond.notify_all();
+        schedule(pipe, 1 - index);
+    }
+
+    // a delivery that saw the input handler first may still be running on the loop
+    if (!m_data->loop->in_loop_thread()) {
+        std::lock_guard<std::mutex> notifying(pipe->sides[index].notify_mutex);
+    }
+
+    if (!recv_requests.empty()) {
+        m_data->loop->post([recv_requests] {
+            for (const recv_request& request : recv_requests) {
+                request.notify(0);
+            }
+        });
+    }
+}
+
+void inproc::close() {
+    disconnect();
+
+    std::lock_guard<std::mutex> lock(registry_mutex);
+    auto it = registry.find(m_info);
+    if (registry.end() != it && this == it->second) {
+        registry.erase(it);
+    }
+
+    std::lock_guard<std::mutex> data_lock(m_data->mutex);
+    m_data->listening = false;
+}
+
+int inproc::send(const char* buffer, int size) {
+    const_buffer buffers[] = {{buffer, buffer ? size : 0}};
+    return sendv(buffers, 1);
+}
+
+int inproc::recv(char* buffer, int size) {
+    mutable_buffer buffers[] = {{buffer, buffer ? size : 0}};
+    return recvv(buffers, 1);
+}
+
+int inproc::sendv(const const_buffer* buffers, int count) {
+    return put_input(buffers, count, true);
+}
+
+int inproc::recvv(const mutable_buffer* buffers, int count) {
+    if (total_size(buffers, count) <= 0) {
+        return 0;
+    }
+
+    std::shared_ptr<inproc_pipe> pipe;
+    int index = 0;
+    {
+        std::lock_guard<std::mutex> lock(m_data->mutex);
+        pipe = m_data->pipe;
+        index = m_data->side;
+    }
+
+    if (!pipe) {
+        return 0;
+    }
+
+    // pushed input takes the bytes, pulling then would race it
+    std::unique_lock<std::mutex> lock(pipe->mutex);
+    inproc_side& side = pipe->sides[index];
+    while (!side.input.size() || side.on_input) {
+        if (pipe->closed || side.on_input) {
+            return 0;
+        }
+
+        if (m_data->loop->in_loop_thread()) {
+            return -1;
+        }
+
+        ++side.recv_waiters;
+        pipe->cond.wait(lock);
+        --side.recv_waiters;
+    }
+
+    int size = 0;
+    for (int i = 0; i < count && side.input.size(); ++i) {
+        if (0 < buffer_size(buffers[i])) {
+            size += side.input.take(buffers[i].data, buffers[i].size, false);
+        }
+    }
+
+    wake_senders(pipe.get(), side);
+    return size;
+}
+
+bool inproc::async_recv(char* buffer, int size, completion_notify notify) {
+    if (!buffer || size <= 0 || !notify) {
+        return false;
+    }
+
+    std::shared_ptr<inproc_pipe> pipe;
+    int index = 0;
+    {
+        std::lock_guard<std::mutex> lock(m_data->mutex);
+        pipe = m_data->pipe;
+        index = m_data->side;
+    }
+
+    if (!pipe) {
+        return false;
+    }
+
+    std::lock_guard<std::mutex> lock(pipe->mutex);
+    inproc_side& side = pipe->sides[index];
+    if (pipe->closed || side.on_input) {
+        return false;
+    }
+
+    side.recv_requests.push_back({buffer, size, notify});
+    if (side.input.size()) {
+        schedule(pipe, index);
+    }
+
+    return true;
+}
+
+bool inproc::serve(session_notify notify) {
+    if (!notify) {
+        return false;
+    }
+
+    return register_name(nullptr, notify);
+}
+
+bool inproc::set_option(endpoint_option option, int value) {
+    return false;
+}
+
+void inproc::set_input(input_notify notify) {
+    std::shared_ptr<inproc_pipe> pipe;
+    int index = 0;
+    {
+        std::lock_guard<std::mutex> lock(m_data->mutex);
+        pipe = m_data->pipe;
+        index = m_data->side;
+    }
+
+    if (!pipe) {
+        return;
+    }
+
+    std::lock_guard<std::mutex> lock(pipe->mutex);
+    pipe->sides[index].on_input = notify;
+    if (pipe->sides[index].input.size() || pipe->closed) {
+        schedule(pipe, index);
+    }
+}
+
+void inproc::post(std::function<void()> task) {
+    m_data->loop->post(task);
+}
+
+// connect never waits here, only the notify is left for the loop
+bool inproc::async_connect(const std::string& remote_info, completion_notify notify) {
+    if (!notify || !connect(remote_info, nullptr)) {
+        return false;
+    }
+
+    m_data->loop->post(std::bind(notify, 1));
+    return true;
+}
+
+bool inproc::async_sendv(const const_buffer* buffers, int count, completion_notify notify) {
+    int res = put_input(buffers, count, false);
+    if (res <= 0) {
+        return false;
+    }
+
+    if (notify) {
+        m_data->loop->post(std::bind(notify, res));
+    }
+
+    return true;
+}
+
+bool inproc::register_name(connected_notify on_connected, session_notify on_session) {
+    if (m_info.empty() || is_listening()) {
+        return false;
+    }
+
+    std::lock_guard<std::mutex> lock(registry_mutex);
+    if (!registry.insert(std::make_pair(m_info, this)).second) {
+        return false;
+    }
+
+    std::lock_guard<std::mutex> data_lock(m_data->mutex);
+    m_data->listening = true;
+    m_data->on_connected = on_connected;
+    m_data->on_session = on_session;
+    return true;
+}
+
+// runs under the registry lock, the listener cannot go away meanwhile. its notify
+// runs on its loop as a socket accept would, never inside connect.
+bool inproc::accept_pipe(const std::shared_ptr<inproc_pipe>& pipe, const std::string& remote_info) {
+    if (m_data->on_session) {
+        inproc* session = new inproc(m_info);
+        session->m_remote_info = remote_info;
+        session->attach_pipe(pipe, 1);
+        m_data->loop->post(std::bind(m_data->on_session, session));
+        return true;
+    }
+
+    if (is_connected()) {
+        return false;
+    }
+
+    m_remote_info = remote_info;
+    attach_pipe(pipe, 1);
+    if (m_data->on_connected) {
+        m_data->loop->post(m_data->on_connected);
+    }
+
+    return true;
+}
+
+void inproc::attach_pipe(const std::shared_ptr<inproc_pipe>& pipe, int side) {
+    {
+        std::lock_guard<std::mutex> lock(pipe->mutex);
+        pipe->sides[side].loop = m_data->loop;
+    }
+
+    std::lock_guard<std::mutex> lock(m_data->mutex);
+    m_data->pipe = pipe;
+    m_data->side = side;
+}
+
+// bounded, a loop thread puts what fits below INPUT_QUEUE_LIMIT and -1 when nothing
+// does, any other thread waits until the peer is below it and then puts everything
+int inproc::put_input(const const_buffer* buffers, int count, bool bounded) {
+    int size = total_size(buffers, count);
+    if (size <= 0) {
+        return 0;
+    }
+
+    std::shared_ptr<inproc_pipe> pipe;
+    int index = 0;
+    {
+        std::lock_guard<std::mutex> lock(m_data->mutex);
+        pipe = m_data->pipe;
+        index = 1 - m_data->side;
+    }
+
+    if (!pipe) {
+        return 0;
+    }
+
+    std::unique_lock<std::mutex> lock(pipe->mutex);
+    inproc_side& side = pipe->sides[index];
+    if (bounded && event_loop::current()) {
+        size = std::min(size, INPUT_QUEUE_LIMIT - side.input.size());
+    } else if (bounded) {
+        ++side.send_waiters;
+        pipe->cond.wait(lock, [&pipe, &side] { return pipe->closed || side.input.size() < INPUT_QUEUE_LIMIT; });
+        --side.send_waiters;
+    }
+
+    if (pipe->closed) {
+        return 0;
+    }
+
+    if (size <= 0) {
+        return -1;
+    }
+
+    int put = 0;
+    for (int i = 0; i < count && put < size; ++i) {
+        int piece = std::min(buffer_size(buffers[i]), size - put);
+        if (0 < piece) {
+            side.input.put(buffers[i].data, piece);
+            put += piece;
+        }
+    }
+
+    schedule(pipe, index);
+    return put;
+}
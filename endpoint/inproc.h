@@ -0,0 +1,71 @@
+/*
+  MIT License
+
+  Copyright (c) 2025 Kong Pengsheng
+
+  Permission is hereby granted, free of charge, to any person obtaining a copy
+  of this software and associated documentation files (the "Software"), to deal
+  in the Software without restriction, including without limitation the rights
+  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+  copies of the Software, and to permit persons to whom the Software is
+  furnished to do so, subject to the following conditions:
+
+  The above copyright notice and this permission notice shall be included in all
+  copies or substantial portions of the Software.
+
+  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+  SOFTWARE.
+*/
+
+#ifndef INPROC_H
+#define INPROC_H
+
+#include <memory>
+#include "tcp.h"
+
+// a pair of endpoints in one process joined in memory, no sockets and no kernel.
+// listen or serve registers info as a name, connect finds it. bytes reach the peer as
+// soon as they are sent and pushed input runs on the event loop as with tcp, so
+// websocket and commun run on top unchanged and show their own cost alone. like a
+// socket buffer the peer holds only so much unread: sendv waits for room, or on a loop
+// thread takes what fits. async_sendv queues all of it, as tcp does.
+class inproc : public tcp {
+public:
+    explicit inproc(const std::string& info = std::string());
+    virtual ~inproc();
+
+public:
+    virtual bool listen(connected_notify notify) override;
+    virtual bool connect(const std::string& remote_info, connected_notify notify) override;
+    virtual bool is_listening() const override;
+    virtual bool is_connected() const override;
+    virtual void disconnect() override;
+    virtual void close() override;
+    virtual int send(const char* buffer, int size) override;
+    virtual int recv(char* buffer, int size) override;
+    virtual int sendv(const const_buffer* buffers, int count) override;
+    virtual int recvv(const mutable_buffer* buffers, int count) override;
+    virtual bool async_recv(char* buffer, int size, completion_notify notify) override;
+    virtual bool async_connect(const std::string& remote_info, completion_notify notify) override;
+    virtual bool serve(session_notify notify) override;
+    virtual bool set_option(endpoint_option option, int value) override;
+    virtual void set_input(input_notify notify) override;
+    virtual void post(std::function<void()> task) override;
+    virtual bool async_sendv(const const_buffer* buffers, int count, completion_notify notify) override;
+
+private:
+    bool register_name(connected_notify on_connected, session_notify on_session);
+    bool accept_pipe(const std::shared_ptr<struct inproc_pipe>& pipe, const std::string& remote_info);
+    void attach_pipe(const std::shared_ptr<struct inproc_pipe>& pipe, int side);
+    int put_input(const const_buffer* buffers, int count, bool bounded);
+
+private:
+    struct inproc_data* m_data;
+};
+
+#endif
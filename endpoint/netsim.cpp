@@ -0,0 +1,468 @@
+/*
+  MIT License
+
+  Copyright (c) 2025 Kong Pengsheng
+
+  Permission is hereby granted, free of charge, to any person obtaining a copy
+  of this software and associated documentation files (the "Software"), to deal
+  in the Software without restriction, including without limitation the rights
+  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+  copies of the Software, and to permit persons to whom the Software is
+  furnished to do so, subject to the following conditions:
+
+  The above copyright notice and this permission notice shall be included in all
+  copies or substantial portions of the Software.
+
+  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+  SOFTWARE.
+*/
+
+#include "netsim.h"
+#include <algorithm>
+#include <chrono>
+#include <cstdlib>
+#include <cstring>
+#include <condition_variable>
+#include <map>
+#include <mutex>
+#include <random>
+#include <sstream>
+#include <thread>
+#include <vector>
+
+using clock_type = std::chrono::steady_clock;
+
+// how much a send may queue before it waits, about a socket send buffer
+const int QUEUE_LIMIT = 1024 * 256;
+// streams leave in pieces no larger than this when no chunk is set
+const int PIECE_SIZE = 1024 * 64;
+
+struct netsim_scheme {
+    const char* name;
+    endpoint::endpoint_type type;
+};
+
+const netsim_scheme SCHEMES[] = {
+    {"tcp:",        endpoint::TCP},
+    {"ws:",         endpoint::WEBSOCKET},
+    {"unix:",       endpoint::UNIX},
+    {"shm:",        endpoint::SHM},
+    {"udp:",        endpoint::UDP},
+    {"inproc:",     endpoint::INPROC},
+    {"bluetooth:",  endpoint::BLUETOOTH}
+};
+
+struct netsim_conditions {
+    int delay = 0;
+    int jitter = 0;
+    int rate = 0;
+    int chunk = 0;
+    int loss = 0;
+    int reorder = 0;
+};
+
+struct netsim_data {
+    endpoint* inner = nullptr;
+    endpoint::endpoint_type type = endpoint::TCP;
+    bool seqpacket = false;
+    std::string scheme;
+    std::string query;
+    netsim_conditions conditions;
+    std::vector<std::pair<endpoint::endpoint_option, int>> inner_options;
+
+    std::mutex mutex;
+    std::condition_variable cond;
+    // pieces by the time they leave, equal times keep the order they came in
+    std::multimap<clock_type::time_point, std::string> queue;
+    int queued = 0;
+    unsigned generation = 0;
+    clock_type::time_point link_free;
+    clock_type::time_point last_release;
+    std::mt19937 random{std::random_device()()};
+    std::thread thread;
+    bool stopping = false;
+};
+
+static bool is_datagram(const netsim_data* data) {
+    return endpoint::UDP == data->type;
+}
+
+// each send reaches the peer as one message or record, cutting it would change them
+static bool keeps_messages(const netsim_data* data) {
+    return is_datagram(data) || endpoint::WEBSOCKET == data->type || (endpoint::UNIX == data->type && data->seqpacket);
+}
+
+static void parse_conditions(const std::string& query, netsim_conditions& conditions) {
+    std::istringstream stream(query);
+    std::string pair;
+    while (std::getline(stream, pair, '&')) {
+        size_t pos = pair.find('=');
+        if (std::string::npos == pos) {
+            continue;
+        }
+
+        std::string key = pair.substr(0, pos);
+        int value = std::max(0, atoi(pair.c_str() + pos + 1));
+        if ("delay" == key) {
+            conditions.delay = value;
+        } else if ("jitter" == key) {
+            conditions.jitter = value;
+        } else if ("rate" == key) {
+            conditions.rate = value;
+        } else if ("chunk" == key) {
+            conditions.chunk = value;
+        } else if ("loss" == key) {
+            conditions.loss = value;
+        } else if ("reorder" == key) {
+            conditions.reorder = value;
+        }
+    }
+}
+
+static bool roll(netsim_data* data, int per_mille) {
+    return 0 < per_mille && (int)(data->random() % 1000) < per_mille;
+}
+
+// when a piece of size leaves, given the pieces queued before it. the link sends one
+// piece after another at rate, then each one takes delay give or take jitter. a stream
+// never lets a piece pass an earlier one, a datagram may when jitter or reorder say so.
+static clock_type::time_point schedule_piece(netsim_data* data, int size) {
+    const netsim_conditions& conditions = data->conditions;
+    clock_type::time_point now = clock_type::now();
+    data->link_free = std::max(data->link_free, now);
+    if (0 < conditions.rate) {
+        data->link_free += std::chrono::nanoseconds((long long)size * 1000000000 / conditions.rate);
+    }
+
+    if (is_datagram(data) && roll(data, conditions.reorder)) {
+        return data->link_free;
+    }
+
+    long long delay = (long long)conditions.delay * 1000;
+    if (0 < conditions.jitter) {
+        delay += (long long)(data->random() % (2 * conditions.jitter * 1000 + 1)) - conditions.jitter * 1000;
+    }
+
+    clock_type::time_point release = data->link_free + std::chrono::microseconds(std::max(0LL, delay));
+    if (!is_datagram(data)) {
+        release = std::max(release, data->last_release);
+        data->last_release = release;
+    }
+
+    return release;
+}
+
+// drops what is still on the way, a send waiting for room returns
+static void drop_queue(netsim_data* data) {
+    std::lock_guard<std::mutex> lock(data->mutex);
+    data->queue.clear();
+    data->queued = 0;
+    data->link_free = clock_type::time_point();
+    data->last_release = clock_type::time_point();
+    ++data->generation;
+    data->cond.notify_all();
+}
+
+netsim::netsim(const std::string& info) : endpoint(info), m_data(new netsim_data) {
+    if (!info.empty()) {
+        open_inner(info);
+    }
+}
+
+netsim::netsim(const netsim* listener, endpoint* inner) : m_data(new netsim_data) {
+    m_data->inner = inner;
+    m_data->type = listener->m_data->type;
+    m_data->seqpacket = listener->m_data->seqpacket;
+    m_data->scheme = listener->m_data->scheme;
+    m_data->query = listener->m_data->query;
+    {
+        std::lock_guard<std::mutex> lock(listener->m_data->mutex);
+        m_data->conditions = listener->m_data->conditions;
+    }
+    update_info();
+}
+
+netsim::~netsim() {
+    close();
+    endpoint::destroy(m_data->inner);
+    delete m_data;
+}
+
+bool netsim::listen(connected_notify notify) {
+    if (!m_data->inner) {
+        return false;
+    }
+
+    bool res = m_data->inner->listen([this, notify] {
+        update_info();
+        if (notify) {
+            notify();
+        }
+    });
+
+    update_info();
+    return res;
+}
+
+bool netsim::connect(const std::string& remote_info, connected_notify notify) {
+    if (!open_inner(remote_info)) {
+        return false;
+    }
+
+    size_t start = m_data->scheme.size();
+    size_t end = remote_info.find('?');
+    std::string address = remote_info.substr(start, std::string::npos == end ? end : end - start);
+    bool res = m_data->inner->connect(address, [this, notify] {
+        update_info();
+        if (notify) {
+            notify();
+        }
+    });
+
+    update_info();
+    return res;
+}
+
+bool netsim::is_listening() const {
+    return m_data->inner && m_data->inner->is_listening();
+}
+
+bool netsim::is_connected() const {
+    return m_data->inner && m_data->inner->is_connected();
+}
+
+void netsim::disconnect() {
+    drop_queue(m_data);
+    if (m_data->inner) {
+        m_data->inner->disconnect();
+    }
+}
+
+void netsim::close() {
+    {
+        std::lock_guard<std::mutex> lock(m_data->mutex);
+        m_data->stopping = true;
+        m_data->cond.notify_all();
+    }
+
+    // closing the inner endpoint first wakes a piece stuck in its send
+    if (m_data->inner) {
+        m_data->inner->close();
+    }
+
+    if (m_data->thread.joinable()) {
+        m_data->thread.join();
+    }
+
+    drop_queue(m_data);
+    m_data->stopping = false;
+}
+
+int netsim::send(const char* buffer, int size) {
+    const_buffer buffers[] = {{buffer, buffer ? size : 0}};
+    return sendv(buffers, 1);
+}
+
+int netsim::recv(char* buffer, int size) {
+    return m_data->inner ? m_data->inner->recv(buffer, size) : 0;
+}
+
+int netsim::sendv(const const_buffer* buffers, int count) {
+    std::string bytes;
+    for (int i = 0; buffers && i < count; ++i) {
+        if (buffers[i].data && 0 < buffers[i].size) {
+            bytes.append(buffers[i].data, buffers[i].size);
+        }
+    }
+
+    if (bytes.empty() || !is_connected()) {
+        return 0;
+    }
+
+    std::unique_lock<std::mutex> lock(m_data->mutex);
+    const netsim_conditions& conditions = m_data->conditions;
+    int piece_size = keeps_messages(m_data) ? (int)bytes.size() : (0 < conditions.chunk ? conditions.chunk : PIECE_SIZE);
+    if (!m_data->thread.joinable()) {
+        m_data->thread = std::thread(&netsim::transmit, this);
+    }
+
+    unsigned generation = m_data->generation;
+    for (int pos = 0; pos < (int)bytes.size(); pos += piece_size) {
+        int size = std::min(piece_size, (int)bytes.size() - pos);
+        m_data->cond.wait(lock, [this, generation, size] {
+            return !m_data->queued || m_data->queued + size <= QUEUE_LIMIT || generation != m_data->generation;
+        });
+
+        if (generation != m_data->generation) {
+            return 0;
+        }
+
+        // a datagram is just gone, a stream cannot skip bytes and breaks instead
+        if (roll(m_data, conditions.loss)) {
+            if (is_datagram(m_data)) {
+                continue;
+            }
+
+            lock.unlock();
+            disconnect();
+            return -1;
+        }
+
+        m_data->queue.emplace(schedule_piece(m_data, size), bytes.substr(pos, size));
+        m_data->queued += size;
+        m_data->cond.notify_all();
+    }
+
+    return (int)bytes.size();
+}
+
+int netsim::recvv(const mutable_buffer* buffers, int count) {
+    return m_data->inner ? m_data->inner->recvv(buffers, count) : 0;
+}
+
+bool netsim::async_recv(char* buffer, int size, completion_notify notify) {
+    return m_data->inner && m_data->inner->async_recv(buffer, size, notify);
+}
+
+bool netsim::serve(session_notify notify) {
+    if (!m_data->inner || !notify) {
+        return false;
+    }
+
+    bool res = m_data->inner->serve([this, notify](endpoint* session) {
+        notify(new netsim(this, session));
+    });
+
+    update_info();
+    return res;
+}
+
+bool netsim::set_option(endpoint_option option, int value) {
+    {
+        // a live link changes under the lock the transmit thread reads it with
+        std::lock_guard<std::mutex> lock(m_data->mutex);
+        netsim_conditions& conditions = m_data->conditions;
+        switch (option) {
+        case OPTION_DELAY:
+            conditions.delay = std::max(0, value);
+            return true;
+        case OPTION_JITTER:
+            conditions.jitter = std::max(0, value);
+            return true;
+        case OPTION_RATE:
+            conditions.rate = std::max(0, value);
+            return true;
+        case OPTION_CHUNK:
+            conditions.chunk = std::max(0, value);
+            return true;
+        case OPTION_LOSS:
+            conditions.loss = std::max(0, value);
+            return true;
+        case OPTION_REORDER:
+            conditions.reorder = std::max(0, value);
+            return true;
+        default:
+            break;
+        }
+    }
+
+    if (OPTION_SEQPACKET == option) {
+        m_data->seqpacket = 0 != value;
+    }
+
+    // kept for an inner endpoint that connect may still create
+    m_data->inner_options.emplace_back(option, value);
+    return !m_data->inner || m_data->inner->set_option(option, value);
+}
+
+// finds the inner endpoint for address, a new one when the scheme changes
+bool netsim::open_inner(const std::string& address) {
+    std::string scheme;
+    endpoint_type type = TCP;
+    for (const netsim_scheme& item : SCHEMES) {
+        if (0 == address.compare(0, strlen(item.name), item.name)) {
+            scheme = item.name;
+            type = item.type;
+            break;
+        }
+    }
+
+    size_t pos = address.find('?');
+    if (std::string::npos != pos) {
+        m_data->query = address.substr(pos);
+        std::lock_guard<std::mutex> lock(m_data->mutex);
+        parse_conditions(address.substr(pos + 1), m_data->conditions);
+    }
+
+    if (m_data->inner && (type != m_data->type || scheme != m_data->scheme)) {
+        if (m_data->inner->is_listening()) {
+            return false;
+        }
+
+        close();
+        endpoint::destroy(m_data->inner);
+        m_data->inner = nullptr;
+    }
+
+    m_data->type = type;
+    m_data->scheme = scheme;
+    if (!m_data->inner) {
+        // a listener names itself in info, a connector leaves its own end to the inner one
+        std::string info = m_info.empty() ? std::string() : address.substr(scheme.size(), pos - scheme.size());
+        m_data->inner = endpoint::create(type, info);
+        for (const auto& option : m_data->inner_options) {
+            m_data->inner->set_option(option.first, option.second);
+        }
+    }
+
+    return nullptr != m_data->inner;
+}
+
+void netsim::update_info() {
+    const std::string& scheme = m_data->scheme;
+    m_info = scheme + m_data->inner->info() + m_data->query;
+    const std::string& remote_info = m_data->inner->remote_info();
+    m_remote_info = remote_info.empty() ? std::string() : scheme + remote_info + m_data->query;
+}
+
+// hands each piece to the inner endpoint when its time comes
+void netsim::transmit() {
+    std::unique_lock<std::mutex> lock(m_data->mutex);
+    while (!m_data->stopping) {
+        if (m_data->queue.empty()) {
+            m_data->cond.wait(lock);
+            continue;
+        }
+
+        auto front = m_data->queue.begin();
+        if (clock_type::now() < front->first) {
+            m_data->cond.wait_until(lock, front->first);
+            continue;
+        }
+
+        std::string piece = std::move(front->second);
+        m_data->queue.erase(front);
+        unsigned generation = m_data->generation;
+        lock.unlock();
+
+        bool sent = is_datagram(m_data) ? 0 < m_data->inner->send(piece.data(), (int)piece.size())
+                                        : m_data->inner->full_send(piece.data(), (int)piece.size());
+
+        lock.lock();
+        if (generation == m_data->generation) {
+            m_data->queued -= (int)piece.size();
+            if (!sent && !is_datagram(m_data)) {
+                m_data->queue.clear();
+                m_data->queued = 0;
+                ++m_data->generation;
+            }
+        }
+
+        m_data->cond.notify_all();
+    }
+}
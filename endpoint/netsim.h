@@ -0,0 +1,68 @@
+/*
+  MIT License
+
+  Copyright (c) 2025 Kong Pengsheng
+
+  Permission is hereby granted, free of charge, to any person obtaining a copy
+  of this software and associated documentation files (the "Software"), to deal
+  in the Software without restriction, including without limitation the rights
+  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+  copies of the Software, and to permit persons to whom the Software is
+  furnished to do so, subject to the following conditions:
+
+  The above copyright notice and this permission notice shall be included in all
+  copies or substantial portions of the Software.
+
+  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+  SOFTWARE.
+*/
+
+#ifndef NETSIM_H
+#define NETSIM_H
+
+#include "endpoint.h"
+
+// wraps another endpoint and shapes what it sends the way a slow or lossy link would,
+// like netem does on the egress of an interface. info and remote_info name the inner
+// endpoint with a scheme, tcp: when there is none, and may carry the conditions after
+// a '?', as in "unix:/tmp/x?delay=40&jitter=5&rate=1000000&chunk=1400&loss=1".
+// delay and jitter are in milliseconds, rate in bytes a second, chunk in bytes, loss
+// and reorder per mille. wrap both sides for a link slow both ways. recv is untouched.
+// over udp, ws: and SEQPACKET unix: a send stays whole whatever the chunk, so message
+// boundaries are delayed but never moved.
+class netsim : public endpoint {
+public:
+    explicit netsim(const std::string& info = std::string());
+    virtual ~netsim();
+
+public:
+    virtual bool listen(connected_notify notify) override;
+    virtual bool connect(const std::string& remote_info, connected_notify notify) override;
+    virtual bool is_listening() const override;
+    virtual bool is_connected() const override;
+    virtual void disconnect() override;
+    virtual void close() override;
+    virtual int send(const char* buffer, int size) override;
+    virtual int recv(char* buffer, int size) override;
+    virtual int sendv(const const_buffer* buffers, int count) override;
+    virtual int recvv(const mutable_buffer* buffers, int count) override;
+    virtual bool async_recv(char* buffer, int size, completion_notify notify) override;
+    virtual bool serve(session_notify notify) override;
+    virtual bool set_option(endpoint_option option, int value) override;
+
+private:
+    netsim(const netsim* listener, endpoint* inner);
+    bool open_inner(const std::string& address);
+    void update_info();
+    void transmit();
+
+private:
+    struct netsim_data* m_data;
+};
+
+#endif
@@ -0,0 +1,635 @@
+/*
+  MIT License
+
+  Copyright (c) 2025 Kong Pengsheng
+
+  Permission is hereby granted, free of charge, to any person obtaining a copy
+  of this software and associated documentation files (the "Software"), to deal
+  in the Software without restriction, including without limitation the rights
+  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+  copies of the Software, and to permit persons to whom the Software is
+  furnished to do so, subject to the following conditions:
+
+  The above copyright notice and this permission notice shall be included in all
+  copies or substantial portions of the Software.
+
+  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+  SOFTWARE.
+*/
+
+#include "shm.h"
+#include "unix_domain.h"
+#include "spin_wait.h"
+#include <cstring>
+#include <cstdint>
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <new>
+#if defined K_LINUX
+#include <climits>
+#include <unistd.h>
+#include <linux/futex.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#endif
+
+const uint32_t SHM_MAGIC = 0x6b73686d;
+const uint32_t SHM_VERSION = 1;
+const int DEFAULT_RING_SIZE = 1024 * 1024;
+const int MAX_RING_SIZE = 1024 * 1024 * 256;
+const int CACHE_LINE_SIZE = 64;
+const char OFFER_TAG = 'S';
+
+// the producer and the consumer each write a cache line of their own
+struct shm_ring {
+    alignas(CACHE_LINE_SIZE) std::atomic<uint64_t> head;
+    std::atomic<uint32_t> data_signal;
+    std::atomic<uint32_t> writer_parked;
+    alignas(CACHE_LINE_SIZE) std::atomic<uint64_t> tail;
+    std::atomic<uint32_t> space_signal;
+    std::atomic<uint32_t> reader_parked;
+};
+
+struct shm_header {
+    uint32_t magic;
+    uint32_t version;
+    uint64_t capacity;
+    std::atomic<uint32_t> closed;
+    shm_ring rings[2];
+};
+
+// the listener writes rings[1] and the connector rings[0]. each ring is mapped twice
+// back to back, so any span of up to capacity bytes is in one piece.
+struct shm_channel {
+    shm_header* header = nullptr;
+    size_t header_size = 0;
+    char* rings[2] = {nullptr, nullptr};
+    uint64_t capacity = 0;
+    int output = 0;
+
+    ~shm_channel();
+    shm_ring& out() { return header->rings[output]; }
+    shm_ring& in() { return header->rings[1 - output]; }
+    char* out_data() { return rings[output] + (out().head.load(std::memory_order_relaxed) & (capacity - 1)); }
+};
+
+struct shm_data {
+    unix_domain* control = nullptr;
+    std::mutex mutex;
+    std::shared_ptr<shm_channel> channel;
+    std::shared_ptr<shm_channel> reserved;
+    int reserved_size = 0;
+    std::mutex send_mutex;
+    std::mutex recv_mutex;
+    endpoint::connected_notify on_connected;
+    endpoint::session_notify on_session;
+    int ring_size = DEFAULT_RING_SIZE;
+    int spin_usec = 0;
+};
+
+#if defined K_LINUX
+static uint64_t page_size() {
+    return (uint64_t)sysconf(_SC_PAGESIZE);
+}
+
+// shared futexes, the peer process sleeps and wakes on the same words
+static void wait_word(std::atomic<uint32_t>& word, uint32_t value) {
+    syscall(SYS_futex, (uint32_t*)&word, FUTEX_WAIT, value, nullptr, nullptr, 0);
+}
+
+static void wake_word(std::atomic<uint32_t>& word) {
+    syscall(SYS_futex, (uint32_t*)&word, FUTEX_WAKE, INT_MAX, nullptr, nullptr, 0);
+}
+
+shm_channel::~shm_channel() {
+    for (char* ring : rings) {
+        if (ring) {
+            munmap(ring, capacity * 2);
+        }
+    }
+
+    if (header) {
+        munmap(header, header_size);
+    }
+}
+
+static char* map_mirror(int fd, uint64_t offset, uint64_t capacity) {
+    void* base = mmap(nullptr, capacity * 2, PROT_NONE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (MAP_FAILED == base) {
+        return nullptr;
+    }
+
+    char* ring = (char*)base;
+    for (uint64_t half = 0; half < 2; ++half) {
+        if (MAP_FAILED == mmap(ring + capacity * half, capacity, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_FIXED, fd, (off_t)offset)) {
+            munmap(base, capacity * 2);
+            return nullptr;
+        }
+    }
+
+    return ring;
+}
+
+static std::shared_ptr<shm_channel> map_channel(int fd, int output) {
+    std::shared_ptr<shm_channel> channel = std::make_shared<shm_channel>();
+    channel->output = output;
+    channel->header_size = page_size();
+
+    struct stat st;
+    if (0 != fstat(fd, &st) || st.st_size < (off_t)channel->header_size) {
+        return nullptr;
+    }
+
+    void* header = mmap(nullptr, channel->header_size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    if (MAP_FAILED == header) {
+        return nullptr;
+    }
+
+    // the peer made the region, nothing in it is taken on trust
+    channel->header = (shm_header*)header;
+    uint64_t capacity = channel->header->capacity;
+    if (SHM_MAGIC != channel->header->magic || SHM_VERSION != channel->header->version ||
+        capacity < channel->header_size || (uint64_t)MAX_RING_SIZE < capacity || 0 != (capacity & (capacity - 1)) ||
+        (uint64_t)st.st_size != channel->header_size + capacity * 2) {
+        return nullptr;
+    }
+
+    channel->capacity = capacity;
+    for (int i = 0; i < 2; ++i) {
+        channel->rings[i] = map_mirror(fd, channel->header_size + capacity * i, capacity);
+        if (!channel->rings[i]) {
+            return nullptr;
+        }
+    }
+
+    return channel;
+}
+
+static int create_region(uint64_t capacity) {
+    int fd = memfd_create("endpoint-shm", MFD_CLOEXEC);
+    if (fd < 0) {
+        return -1;
+    }
+
+    uint64_t header_size = page_size();
+    void* header = MAP_FAILED;
+    if (0 == ftruncate(fd, (off_t)(header_size + capacity * 2))) {
+        header = mmap(nullptr, header_size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    }
+
+    if (MAP_FAILED == header) {
+        ::close(fd);
+        return -1;
+    }
+
+    shm_header* init = new (header) shm_header();
+    init->magic = SHM_MAGIC;
+    init->version = SHM_VERSION;
+    init->capacity = capacity;
+    munmap(header, header_size);
+    return fd;
+}
+
+static void close_region(int fd) {
+    ::close(fd);
+}
+#else
+static uint64_t page_size() {
+    return 4096;
+}
+
+static void wait_word(std::atomic<uint32_t>& word, uint32_t value) {
+}
+
+static void wake_word(std::atomic<uint32_t>& word) {
+}
+
+shm_channel::~shm_channel() {
+}
+
+static std::shared_ptr<shm_channel> map_channel(int fd, int output) {
+    return nullptr;
+}
+
+static int create_region(uint64_t capacity) {
+    return -1;
+}
+
+static void close_region(int fd) {
+}
+#endif
+
+static uint64_t ring_capacity(int size) {
+    uint64_t capacity = page_size();
+    while (capacity < (uint64_t)size) {
+        capacity <<= 1;
+    }
+    return capacity;
+}
+
+static bool is_closed(shm_channel* channel) {
+    return 0 != channel->header->closed.load(std::memory_order_acquire);
+}
+
+// wakes every sleeper of both rings, the peer's included
+static void close_channel(shm_channel* channel) {
+    channel->header->closed.store(1, std::memory_order_release);
+    for (shm_ring& ring : channel->header->rings) {
+        ring.data_signal.fetch_add(1, std::memory_order_release);
+        ring.space_signal.fetch_add(1, std::memory_order_release);
+        wake_word(ring.data_signal);
+        wake_word(ring.space_signal);
+    }
+}
+
+// spins for spin_usec, then raises parked and sleeps on signal. the fence pairs with
+// the one in wake_ring, either this side sees the ring move or the mover sees parked.
+// false if the channel closes first.
+template<class ready_t>
+static bool wait_ring(shm_channel* channel, std::atomic<uint32_t>& signal, std::atomic<uint32_t>& parked,
+                      int spin_usec, ready_t ready) {
+    std::chrono::steady_clock::time_point deadline;
+    if (0 < spin_usec) {
+        deadline = std::chrono::steady_clock::now() + std::chrono::microseconds(spin_usec);
+    }
+
+    while (!ready()) {
+        if (is_closed(channel)) {
+            return false;
+        }
+
+        if (0 < spin_usec && std::chrono::steady_clock::now() < deadline) {
+            cpu_relax();
+            continue;
+        }
+
+        uint32_t seq = signal.load(std::memory_order_acquire);
+        parked.store(1, std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        if (!ready() && !is_closed(channel)) {
+            wait_word(signal, seq);
+        }
+        parked.store(0, std::memory_order_relaxed);
+    }
+
+    return true;
+}
+
+static void wake_ring(std::atomic<uint32_t>& signal, std::atomic<uint32_t>& parked) {
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    if (parked.load(std::memory_order_relaxed)) {
+        signal.fetch_add(1, std::memory_order_release);
+        wake_word(signal);
+    }
+}
+
+static void publish(shm_ring& ring, uint64_t head) {
+    if (head != ring.head.load(std::memory_order_relaxed)) {
+        ring.head.store(head, std::memory_order_release);
+        wake_ring(ring.data_signal, ring.reader_parked);
+    }
+}
+
+// copies everything, publishing whenever the ring fills up so the peer can drain it
+static int write_ring(shm_channel* channel, const endpoint::const_buffer* buffers, int count, int spin_usec) {
+    shm_ring& ring = channel->out();
+    char* data = channel->rings[channel->output];
+    uint64_t head = ring.head.load(std::memory_order_relaxed);
+    uint64_t room = 0;
+    int size = 0;
+    for (int i = 0; buffers && i < count; ++i) {
+        if (!buffers[i].data || buffers[i].size <= 0) {
+            continue;
+        }
+
+        int offset = 0;
+        while (offset < buffers[i].size) {
+            if (0 == room) {
+                publish(ring, head);
+                bool ready = wait_ring(channel, ring.space_signal, ring.writer_parked, spin_usec, [&] {
+                    room = channel->capacity - (head - ring.tail.load(std::memory_order_acquire));
+                    return 0 < room;
+                });
+                if (!ready || is_closed(channel)) {
+                    return size ? -1 : 0;
+                }
+            }
+
+            int piece = (int)std::min<uint64_t>(room, buffers[i].size - offset);
+            memcpy(data + (head & (channel->capacity - 1)), buffers[i].data + offset, piece);
+            head += piece;
+            room -= piece;
+            offset += piece;
+            size += piece;
+        }
+    }
+
+    publish(ring, head);
+    return size;
+}
+
+// takes what is there once anything is, 0 when closed and drained
+static int read_ring(shm_channel* channel, const endpoint::mutable_buffer* buffers, int count, int spin_usec) {
+    shm_ring& ring = channel->in();
+    const char* data = channel->rings[1 - channel->output];
+    uint64_t tail = ring.tail.load(std::memory_order_relaxed);
+    uint64_t available = 0;
+    bool ready = wait_ring(channel, ring.data_signal, ring.reader_parked, spin_usec, [&] {
+        available = std::min(ring.head.load(std::memory_order_acquire) - tail, channel->capacity);
+        return 0 < available;
+    });
+    if (!ready) {
+        return 0;
+    }
+
+    int size = 0;
+    for (int i = 0; buffers && i < count && 0 < available; ++i) {
+        if (!buffers[i].data || buffers[i].size <= 0) {
+            continue;
+        }
+
+        int piece = (int)std::min<uint64_t>(available, buffers[i].size);
+        memcpy(buffers[i].data, data + (tail & (channel->capacity - 1)), piece);
+        tail += piece;
+        available -= piece;
+        size += piece;
+    }
+
+    ring.tail.store(tail, std::memory_order_release);
+    wake_ring(ring.space_signal, ring.writer_parked);
+    return size;
+}
+
+template<class buffer_t>
+static bool has_bytes(const buffer_t* buffers, int count) {
+    for (int i = 0; buffers && i < count; ++i) {
+        if (buffers[i].data && 0 < buffers[i].size) {
+            return true;
+        }
+    }
+    return false;
+}
+
+static std::shared_ptr<shm_channel> current_channel(shm_data* data) {
+    std::lock_guard<std::mutex> lock(data->mutex);
+    return data->channel;
+}
+
+// the control socket carries nothing more, it going quiet means the peer is gone
+static void attach_channel(shm_data* data, const std::shared_ptr<shm_channel>& channel) {
+    {
+        std::lock_guard<std::mutex> lock(data->mutex);
+        data->channel = channel;
+    }
+
+    data->control->set_input([channel](const char* buffer, int size) {
+        if (size <= 0) {
+            close_channel(channel.get());
+        }
+    });
+}
+
+shm::shm(const std::string& info) : shm(info, new unix_domain(info)) {
+}
+
+shm::shm(const std::string& info, unix_domain* control) : endpoint(info), m_data(new shm_data) {
+    m_data->control = control;
+}
+
+shm::~shm() {
+    close();
+    endpoint::destroy(m_data->control);
+    delete m_data;
+}
+
+bool shm::listen(connected_notify notify) {
+    m_data->on_connected = notify;
+    m_data->on_session = nullptr;
+    if (!m_data->control->listen(std::bind(&shm::accept_channel, this))) {
+        return false;
+    }
+
+    m_info = m_data->control->info();
+    return true;
+}
+
+bool shm::connect(const std::string& remote_info, connected_notify notify) {
+    disconnect();
+    if (!m_data->control->connect(remote_info, nullptr) || !join_channel()) {
+        disconnect();
+        return false;
+    }
+
+    m_info = m_data->control->info();
+    m_remote_info = m_data->control->remote_info();
+
+    if (notify) {
+        notify();
+    }
+
+    return true;
+}
+
+bool shm::is_listening() const {
+    return m_data->control->is_listening();
+}
+
+bool shm::is_connected() const {
+    std::shared_ptr<shm_channel> channel = current_channel(m_data);
+    return channel && !is_closed(channel.get());
+}
+
+void shm::disconnect() {
+    std::shared_ptr<shm_channel> channel;
+    {
+        std::lock_guard<std::mutex> lock(m_data->mutex);
+        channel.swap(m_data->channel);
+    }
+
+    if (channel) {
+        close_channel(channel.get());
+    }
+
+    m_data->control->disconnect();
+}
+
+void shm::close() {
+    disconnect();
+    m_data->control->close();
+}
+
+int shm::send(const char* buffer, int size) {
+    const_buffer buffers[] = {{buffer, buffer ? size : 0}};
+    return sendv(buffers, 1);
+}
+
+int shm::recv(char* buffer, int size) {
+    mutable_buffer buffers[] = {{buffer, buffer ? size : 0}};
+    return recvv(buffers, 1);
+}
+
+int shm::sendv(const const_buffer* buffers, int count) {
+    std::shared_ptr<shm_channel> channel = current_channel(m_data);
+    if (!channel || !has_bytes(buffers, count)) {
+        return 0;
+    }
+
+    std::lock_guard<std::mutex> lock(m_data->send_mutex);
+    return write_ring(channel.get(), buffers, count, m_data->spin_usec);
+}
+
+int shm::recvv(const mutable_buffer* buffers, int count) {
+    std::shared_ptr<shm_channel> channel = current_channel(m_data);
+    if (!channel || !has_bytes(buffers, count)) {
+        return 0;
+    }
+
+    std::lock_guard<std::mutex> lock(m_data->recv_mutex);
+    return read_ring(channel.get(), buffers, count, m_data->spin_usec);
+}
+
+bool shm::serve(session_notify notify) {
+    m_data->on_connected = nullptr;
+    m_data->on_session = notify;
+    bool res = m_data->control->serve([this](endpoint* session) {
+        shm* peer = new shm(m_info, (unix_domain*)session);
+        peer->m_data->ring_size = m_data->ring_size;
+        peer->m_data->spin_usec = m_data->spin_usec;
+        if (!peer->offer_channel()) {
+            endpoint::destroy(peer);
+            return;
+        }
+
+        peer->m_remote_info = session->remote_info();
+        m_data->on_session(peer);
+    });
+    if (!res) {
+        return false;
+    }
+
+    m_info = m_data->control->info();
+    return true;
+}
+
+bool shm::set_option(endpoint_option option, int value) {
+    if (is_listening() || is_connected()) {
+        return false;
+    }
+
+    switch (option) {
+    case OPTION_RING_SIZE:
+        if (value <= 0 || MAX_RING_SIZE < value) {
+            return false;
+        }
+
+        m_data->ring_size = value;
+        return true;
+    case OPTION_SPIN:
+        if (value < 0) {
+            return false;
+        }
+
+        m_data->spin_usec = value;
+        return true;
+    default:
+        break;
+    }
+
+    return false;
+}
+
+endpoint::mutable_buffer shm::reserve(int size) {
+    std::shared_ptr<shm_channel> channel = current_channel(m_data);
+    if (!channel || size <= 0) {
+        return {nullptr, 0};
+    }
+
+    shm_ring& ring = channel->out();
+    uint64_t head = ring.head.load(std::memory_order_relaxed);
+    uint64_t wanted = std::min<uint64_t>(size, channel->capacity);
+    bool ready = wait_ring(channel.get(), ring.space_signal, ring.writer_parked, m_data->spin_usec, [&] {
+        return wanted <= channel->capacity - (head - ring.tail.load(std::memory_order_acquire));
+    });
+    if (!ready || is_closed(channel.get())) {
+        return {nullptr, 0};
+    }
+
+    // the mapping stays until the commit even if disconnect comes in between
+    m_data->reserved = channel;
+    m_data->reserved_size = (int)wanted;
+    return {channel->out_data(), (int)wanted};
+}
+
+bool shm::commit(int size) {
+    std::shared_ptr<shm_channel> channel;
+    channel.swap(m_data->reserved);
+    if (!channel || size < 0 || m_data->reserved_size < size) {
+        return false;
+    }
+
+    shm_ring& ring = channel->out();
+    publish(ring, ring.head.load(std::memory_order_relaxed) + size);
+    return !is_closed(channel.get());
+}
+
+void shm::accept_channel() {
+    if (!offer_channel()) {
+        m_data->control->disconnect();
+        return;
+    }
+
+    m_remote_info = m_data->control->remote_info();
+    if (m_data->on_connected) {
+        m_data->on_connected();
+    }
+}
+
+// the listening side makes the rings and passes them over the control socket
+bool shm::offer_channel() {
+    int fd = create_region(ring_capacity(m_data->ring_size));
+    if (fd < 0) {
+        return false;
+    }
+
+    std::shared_ptr<shm_channel> channel = map_channel(fd, 1);
+    bool res = channel && 1 == m_data->control->send_fds(&OFFER_TAG, 1, &fd, 1);
+    close_region(fd);
+    if (res) {
+        attach_channel(m_data, channel);
+    }
+
+    return res;
+}
+
+bool shm::join_channel() {
+    char tag = 0;
+    int fd = -1;
+    int count = 1;
+    int res = m_data->control->recv_fds(&tag, 1, &fd, &count);
+    if (1 != count) {
+        return false;
+    }
+
+    std::shared_ptr<shm_channel> channel;
+    if (1 == res && OFFER_TAG == tag) {
+        channel = map_channel(fd, 0);
+    }
+    close_region(fd);
+
+    if (!channel) {
+        return false;
+    }
+
+    attach_channel(m_data, channel);
+    return true;
+}
@@ -0,0 +1,72 @@
+/*
+  MIT License
+
+  Copyright (c) 2025 Kong Pengsheng
+
+  Permission is hereby granted, free of charge, to any person obtaining a copy
+  of this software and associated documentation files (the "Software"), to deal
+  in the Software without restriction, including without limitation the rights
+  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+  copies of the Software, and to permit persons to whom the Software is
+  furnished to do so, subject to the following conditions:
+
+  The above copyright notice and this permission notice shall be included in all
+  copies or substantial portions of the Software.
+
+  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+  SOFTWARE.
+*/
+
+#ifndef SHM_H
+#define SHM_H
+
+#include "endpoint.h"
+
+// same host streams through a pair of rings in shared memory, one per direction.
+// the rings are handed over a UNIX socket at info, a path or @name, which then only
+// watches for the peer going away. bytes move without syscalls while both sides keep
+// up, a side with nothing to do sleeps on a futex until the other wakes it. linux only.
+// one thread sends and one receives at a time, like a pipe.
+class shm : public endpoint {
+public:
+    explicit shm(const std::string& info = std::string());
+    virtual ~shm();
+
+public:
+    virtual bool listen(connected_notify notify) override;
+    virtual bool connect(const std::string& remote_info, connected_notify notify) override;
+    virtual bool is_listening() const override;
+    virtual bool is_connected() const override;
+    virtual void disconnect() override;
+    virtual void close() override;
+    virtual int send(const char* buffer, int size) override;
+    virtual int recv(char* buffer, int size) override;
+    virtual int sendv(const const_buffer* buffers, int count) override;
+    virtual int recvv(const mutable_buffer* buffers, int count) override;
+    virtual bool serve(session_notify notify) override;
+    virtual bool set_option(endpoint_option option, int value) override;
+
+public:
+    // writes straight into the ring, reserve waits for size bytes of room, at most the
+    // ring size, and returns them in one piece. commit passes the first size of them to
+    // the peer. empty when disconnected, not to be mixed with a concurrent send.
+    mutable_buffer reserve(int size);
+    bool commit(int size);
+
+private:
+    shm(const std::string& info, class unix_domain* control);
+
+    void accept_channel();
+    bool offer_channel();
+    bool join_channel();
+
+private:
+    struct shm_data* m_data;
+};
+
+#endif
@@ -25,19 +25,131 @@
 #ifndef SOCKET_H
 #define SOCKET_H
 
+#include <string>
+#include <cstring>
+#include <cstddef>
 #if defined K_WINDOWS
 #include <WS2tcpip.h>
 #include <Windows.h>
+#include <afunix.h>
 using socket_t = SOCKET;
 using socklen_t = int;
+const int SEND_FLAGS = 0;
 #elif defined K_LINUX
 #include <unistd.h>
+#include <fcntl.h>
+#include <cerrno>
 #include <arpa/inet.h>
+#include <sys/un.h>
 using socket_t = int;
 const socket_t INVALID_SOCKET = -1;
+const int SEND_FLAGS = MSG_NOSIGNAL;
 #define closesocket ::close
 #endif
 
+const unsigned short DEFAULT_PORT = 28800;
+
+inline bool set_nonblocking(socket_t s) {
+#if defined K_WINDOWS
+    u_long mode = 1;
+    return 0 == ioctlsocket(s, FIONBIO, &mode);
+#elif defined K_LINUX
+    int flags = fcntl(s, F_GETFL);
+    return 0 <= flags && 0 == fcntl(s, F_SETFL, flags | O_NONBLOCK);
+#endif
+}
+
+inline bool would_block() {
+#if defined K_WINDOWS
+    return WSAEWOULDBLOCK == WSAGetLastError();
+#elif defined K_LINUX
+    return EAGAIN == errno || EWOULDBLOCK == errno || EINTR == errno;
+#endif
+}
+
+// a nonblocking connect under way, done once the socket turns writable
+inline bool connect_pending() {
+#if defined K_WINDOWS
+    return WSAEWOULDBLOCK == WSAGetLastError();
+#elif defined K_LINUX
+    return EINPROGRESS == errno;
+#endif
+}
+
+inline bool connection_refused() {
+#if defined K_WINDOWS
+    return WSAECONNREFUSED == WSAGetLastError();
+#elif defined K_LINUX
+    return ECONNREFUSED == errno;
+#endif
+}
+
+struct socket_address {
+    sockaddr_storage storage;
+    socklen_t size;
+
+    socket_address() : storage(), size(sizeof(sockaddr_storage)) {}
+    sockaddr* get() { return (sockaddr*)&storage; }
+};
+
+// ip:port for AF_INET, a filesystem path or @name in the abstract namespace for AF_UNIX
+inline bool fill_address(socket_address& address, int family, const std::string& info) {
+    address = socket_address();
+    if (AF_UNIX == family) {
+        sockaddr_un* addr = (sockaddr_un*)&address.storage;
+        if (info.empty() || sizeof(addr->sun_path) <= info.size()) {
+            return false;
+        }
+
+        addr->sun_family = AF_UNIX;
+        memcpy(addr->sun_path, info.data(), info.size());
+        size_t size = info.size() + 1;
+        if ('@' == info[0]) {
+            addr->sun_path[0] = '\0';
+            size = info.size();
+        }
+
+        address.size = (socklen_t)(offsetof(sockaddr_un, sun_path) + size);
+        return true;
+    }
+
+    sockaddr_in* addr = (sockaddr_in*)&address.storage;
+    addr->sin_family = AF_INET;
+    size_t delim_pos = info.find(':');
+    if (std::string::npos != delim_pos) {
+        addr->sin_port = htons(std::stoi(info.substr(delim_pos + 1)));
+        std::string ip(info.substr(0, delim_pos));
+        inet_pton(AF_INET, ip.c_str(), &addr->sin_addr);
+    } else {
+        addr->sin_port = htons(DEFAULT_PORT);
+        inet_pton(AF_INET, info.c_str(), &addr->sin_addr);
+    }
+
+    address.size = sizeof(sockaddr_in);
+    return true;
+}
+
+inline std::string get_info(const socket_address& address) {
+    if (AF_UNIX == address.storage.ss_family) {
+        const sockaddr_un* addr = (const sockaddr_un*)&address.storage;
+        int size = (int)address.size - (int)offsetof(sockaddr_un, sun_path);
+        if (size <= 0) {
+            return std::string();
+        }
+
+        if ('\0' == addr->sun_path[0]) {
+            return '@' + std::string(addr->sun_path + 1, size - 1);
+        }
+
+        return std::string(addr->sun_path, strnlen(addr->sun_path, size));
+    }
+
+    const sockaddr_in* addr = (const sockaddr_in*)&address.storage;
+    char buffer[INET_ADDRSTRLEN];
+    inet_ntop(AF_INET, &addr->sin_addr, buffer, sizeof(buffer));
+    return buffer + (':' + std::to_string(ntohs(addr->sin_port)));
+}
+
 class socket_data {
 public:
     static void init() {
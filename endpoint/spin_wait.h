@@ -0,0 +1,83 @@
+/*
+  MIT License
+
+  Copyright (c) 2025 Kong Pengsheng
+
+  Permission is hereby granted, free of charge, to any person obtaining a copy
+  of this software and associated documentation files (the "Software"), to deal
+  in the Software without restriction, including without limitation the rights
+  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+  copies of the Software, and to permit persons to whom the Software is
+  furnished to do so, subject to the following conditions:
+
+  The above copyright notice and this permission notice shall be included in all
+  copies or substantial portions of the Software.
+
+  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+  SOFTWARE.
+*/
+
+#ifndef SPIN_WAIT_H
+#define SPIN_WAIT_H
+
+#include <atomic>
+
+#if defined _MSC_VER && (defined _M_X64 || defined _M_IX86)
+#include <intrin.h>
+#endif
+
+// how a thread taking from an empty queue waits. WAIT_BLOCK sleeps on the queue at once,
+// WAIT_SPIN first looks again a number of times with a pause in between, which saves the
+// sleep and wake when the bytes are only a few microseconds away. WAIT_POLL never sleeps
+// and keeps its core busy for as long as it waits. both only pay off while the taker
+// and whoever fills the queue have cores of their own.
+enum wait_mode {
+    WAIT_BLOCK,
+    WAIT_SPIN,
+    WAIT_POLL
+};
+
+// tells the core this is a spin loop, the sibling hyperthread gets the pipeline meanwhile
+inline void cpu_relax() {
+#if defined __x86_64__ || defined __i386__
+    __builtin_ia32_pause();
+#elif defined __aarch64__
+    asm volatile("yield");
+#elif defined _M_X64 || defined _M_IX86
+    _mm_pause();
+#endif
+}
+
+// looks at ready until it holds, at most spins times for WAIT_SPIN and for ever for
+// WAIT_POLL. false means the caller should go to sleep
+template<class ready_t>
+inline bool spin_until(wait_mode mode, int spins, ready_t ready) {
+    for (int i = 0; WAIT_POLL == mode || (WAIT_SPIN == mode && i < spins); ++i) {
+        if (ready()) {
+            return true;
+        }
+
+        cpu_relax();
+    }
+
+    return ready();
+}
+
+// a queue bumps wakes wherever it wakes its takers, so a take can spin on it with the
+// lock released and still see a put or an exit. returns with the lock held again,
+// true once wakes moved and false when the caller should go to sleep
+template<class lock_t>
+inline bool spin_until_woken(lock_t& lock, const std::atomic<unsigned>& wakes, wait_mode mode, int spins) {
+    unsigned seen = wakes.load(std::memory_order_relaxed);
+    lock.unlock();
+    bool moved = spin_until(mode, spins, [&wakes, seen] { return seen != wakes.load(std::memory_order_acquire); });
+    lock.lock();
+    return moved;
+}
+
+#endif
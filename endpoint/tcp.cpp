@@ -25,254 +25,1417 @@
 #include "tcp.h"
 #include "socket.h"
 #include <cstring>
-#include <future>
+#include <cstddef>
+#include <cstdio>
+#include <algorithm>
+#include <mutex>
+#include <condition_variable>
+#include <deque>
+#include <memory>
 #include <vector>
+#include "byte_queue.h"
+#include "endpoint_util.h"
+#include "event_loop.h"
+#include "function_ref.h"
 #if defined K_WINDOWS
 #include <iphlpapi.h>
 #elif defined K_LINUX
 #include <ifaddrs.h>
 #include <net/if.h>
+#include <sys/stat.h>
 #endif
 
-const unsigned short DEFAULT_PORT = 28800;
 const int BROADCAST_INTERVAL = 10;
+const int INPUT_BUFFER_SIZE = 1024 * 64;
+const int INPUT_QUEUE_LIMIT = 1024 * 1024 * 4;
+const int OUTPUT_QUEUE_LIMIT = 1024 * 1024 * 4;
+const int MAX_IO_BUFFERS = 64;
+const int MAX_PASSED_FDS = 64;
+
+struct send_request {
+    long long mark;
+    int size;
+    endpoint::completion_notify notify;
+};
+
+// sessions accepted by a shard stay on its loop, plain listeners spread them over the pool
+struct listener_shard {
+    event_loop* loop;
+    socket_t listen_socket;
+    event_loop* session_loop;
+};
 
 struct tcp_data {
+    endpoint::endpoint_backend backend = endpoint::BACKEND_SOCKET;
+    event_loop* loop = nullptr;
+    int family = AF_INET;
+    int type = SOCK_STREAM;
     socket_t listen_socket = INVALID_SOCKET;
+    // the socket file the listener bound, close removes it only while it is still that one
+    unsigned long long path_dev = 0;
+    unsigned long long path_ino = 0;
+    int shard_count = 1;
+    bool pin_cores = false;
+    std::vector<listener_shard> shards;
     socket_t connect_socket = INVALID_SOCKET;
-    std::future<void> listen_future;
-    std::future<void> broadcast_future;
-    std::condition_variable_any m_cond_closed;
+    // an async_connect under way, disconnect cancels it
+    socket_t connecting_socket = INVALID_SOCKET;
+    endpoint::completion_notify on_connect;
+    endpoint::connected_notify on_connected;
+    endpoint::session_notify on_session;
+    std::mutex mutex;
+    std::condition_variable cond;
+    unsigned events = event_loop::IO_NONE;
+    bool readable = false;
+    bool writable = false;
+    int recv_waiters = 0;
+    int send_waiters = 0;
+    byte_queue output;
+    long long output_queued = 0;
+    long long output_sent = 0;
+    int flush_size = 0;
+    int flush_delay = 0;
+    bool holding = false;
+    event_loop::timer_id flush_timer = 0;
+    // owns nothing, a posted release sees it expire once the data is deleted
+    std::shared_ptr<tcp_data> self;
+    tcp::input_notify on_input;
+    byte_queue input;
+    bool pulling = false;
+    bool receiving = false;
+    bool input_closed = false;
+    int input_result = 0;
+    bool sending = false;
+    std::deque<recv_request> recv_requests;
+    std::deque<send_request> send_requests;
+    socket_t broadcast_socket = INVALID_SOCKET;
+    std::vector<in_addr> broadcast_addrs;
+    std::string broadcast_name;
+    event_loop::timer_id broadcast_timer = 0;
 };
 
-static void fill_sockaddr(sockaddr_in& addr, const std::string& info) {
-    addr.sin_family = AF_INET;
-    size_t delim_pos = info.find(':');
-    if (std::string::npos != delim_pos) {
-        addr.sin_port = htons(std::stoi(info.substr(delim_pos + 1)));
-        std::string ip(info.substr(0, delim_pos));
-        inet_pton(AF_INET, ip.c_str(), &addr.sin_addr);
-    } else {
-        addr.sin_port = htons(DEFAULT_PORT);
-        inet_pton(AF_INET, info.c_str(), &addr.sin_addr);
+static std::vector<in_addr> get_broadcast_addrs() {
+    std::vector<in_addr> sin_addrs;
+#if defined K_WINDOWS
+    ULONG size = 0;
+    GetAdaptersInfo(nullptr, &size);
+    if (!size) {
+        return sin_addrs;
+    }
+
+    PIP_ADAPTER_INFO infos = (PIP_ADAPTER_INFO) new char[size];
+    if (ERROR_SUCCESS == GetAdaptersInfo(infos, &size)) {
+        for (PIP_ADAPTER_INFO info = infos; info; info = info->Next) {
+            for (PIP_ADDR_STRING string = &info->IpAddressList; string; string = string->Next) {
+                in_addr address;
+                inet_pton(AF_INET, string->IpAddress.String, &address);
+                if (INADDR_ANY != address.s_addr && INADDR_LOOPBACK != address.s_addr) {
+                    in_addr mask, broadcast;
+                    inet_pton(AF_INET, string->IpMask.String, &mask);
+                    broadcast.s_addr = address.s_addr | ~mask.s_addr;
+                    sin_addrs.push_back(broadcast);
+                }
+            }
+        }
+    }
+
+    delete[] (char*)infos;
+#elif defined K_LINUX
+    ifaddrs* ifas = nullptr;
+    if (0 == getifaddrs(&ifas)) {
+        for (ifaddrs* ifa = ifas; ifa; ifa = ifa->ifa_next) {
+            if ((IFF_BROADCAST & ifa->ifa_flags) && ifa->ifa_broadaddr && AF_INET == ifa->ifa_broadaddr->sa_family) {
+                sin_addrs.push_back(((sockaddr_in*)ifa->ifa_broadaddr)->sin_addr);
+            }
+        }
+        freeifaddrs(ifas);
+    }
+#endif
+
+    return sin_addrs;
+}
+
+struct accepted_stream {
+    socket_t connect_socket;
+    std::string remote_info;
+    event_loop* loop;
+};
+
+struct pending_connect {
+    socket_t connect_socket;
+    socket_address remote_addr;
+};
+
+// AF_UNIX keeps to the socket backend, io_uring receives would drop passed fds
+static event_loop::loop_backend loop_backend(const tcp_data* data) {
+    return endpoint::BACKEND_IO_URING == data->backend && AF_INET == data->family ?
+           event_loop::BACKEND_IO_URING : event_loop::BACKEND_POLL;
+}
+
+static bool is_path(const socket_address& address) {
+    const sockaddr_un* addr = (const sockaddr_un*)&address.storage;
+    return AF_UNIX == address.storage.ss_family && (int)offsetof(sockaddr_un, sun_path) < (int)address.size &&
+           '\0' != addr->sun_path[0];
+}
+
+// device and inode of the socket file at path, false for anything else there
+static bool socket_file_id(const char* path, unsigned long long& dev, unsigned long long& ino) {
+#if defined K_WINDOWS
+    // a unix socket is a reparse point of its own tag, told apart by when it was made
+    WIN32_FIND_DATAA find;
+    HANDLE handle = FindFirstFileA(path, &find);
+    if (INVALID_HANDLE_VALUE == handle) {
+        return false;
+    }
+
+    FindClose(handle);
+    if (!(FILE_ATTRIBUTE_REPARSE_POINT & find.dwFileAttributes) || IO_REPARSE_TAG_AF_UNIX != find.dwReserved0) {
+        return false;
+    }
+
+    dev = 0;
+    ino = (unsigned long long)find.ftCreationTime.dwHighDateTime << 32 | find.ftCreationTime.dwLowDateTime;
+    return true;
+#elif defined K_LINUX
+    struct stat st;
+    if (0 != lstat(path, &st) || !S_ISSOCK(st.st_mode)) {
+        return false;
+    }
+
+    dev = st.st_dev;
+    ino = st.st_ino;
+    return true;
+#endif
+}
+
+// a socket file left behind by a listener that is gone would fail the bind. anything
+// else at the path, or a socket someone still listens on, is left alone
+static void remove_stale_socket(const tcp_data* data, socket_address& address) {
+    const char* path = ((const sockaddr_un*)&address.storage)->sun_path;
+    unsigned long long dev = 0, ino = 0;
+    if (!socket_file_id(path, dev, ino)) {
+        return;
+    }
+
+    socket_t probe = socket(AF_UNIX, data->type, 0);
+    if (INVALID_SOCKET == probe) {
+        return;
+    }
+
+    bool stale = 0 != ::connect(probe, address.get(), address.size) && connection_refused();
+    closesocket(probe);
+    if (stale) {
+        std::remove(path);
+    }
+}
+
+static socket_t open_listen_socket(const tcp_data* data, socket_address& local_addr, bool reuse_port) {
+    socket_t listen_socket = socket(data->family, data->type, 0);
+    if (INVALID_SOCKET == listen_socket) {
+        return INVALID_SOCKET;
+    }
+
+    if (is_path(local_addr)) {
+        remove_stale_socket(data, local_addr);
+    }
+
+#if defined SO_REUSEPORT
+    if (reuse_port) {
+        int opt = 1;
+        setsockopt(listen_socket, SOL_SOCKET, SO_REUSEPORT, (char*)&opt, sizeof(opt));
+    }
+#endif
+
+    socklen_t addr_len = sizeof(sockaddr_storage);
+    if (0 != bind(listen_socket, local_addr.get(), local_addr.size) ||
+        0 != ::listen(listen_socket, SOMAXCONN) ||
+        0 != getsockname(listen_socket, local_addr.get(), &addr_len)) {
+        closesocket(listen_socket);
+        return INVALID_SOCKET;
+    }
+
+    local_addr.size = addr_len;
+
+    return listen_socket;
+}
+
+// gathers one send over the buffers, at most MAX_IO_BUFFERS of them at once
+static int send_buffers(socket_t s, const endpoint::const_buffer* buffers, int count) {
+    count = std::min(count, MAX_IO_BUFFERS);
+#if defined K_WINDOWS
+    WSABUF bufs[MAX_IO_BUFFERS];
+    for (int i = 0; i < count; ++i) {
+        bufs[i].buf = (CHAR*)buffers[i].data;
+        bufs[i].len = (ULONG)buffer_size(buffers[i]);
+    }
+
+    DWORD sent = 0;
+    return 0 == WSASend(s, bufs, count, &sent, 0, nullptr, nullptr) ? (int)sent : -1;
+#elif defined K_LINUX
+    iovec iovs[MAX_IO_BUFFERS];
+    for (int i = 0; i < count; ++i) {
+        iovs[i].iov_base = (void*)buffers[i].data;
+        iovs[i].iov_len = buffer_size(buffers[i]);
+    }
+
+    msghdr msg = {0};
+    msg.msg_iov = iovs;
+    msg.msg_iovlen = count;
+    return (int)::sendmsg(s, &msg, SEND_FLAGS);
+#endif
+}
+
+static int recv_buffers(socket_t s, const endpoint::mutable_buffer* buffers, int count) {
+    count = std::min(count, MAX_IO_BUFFERS);
+#if defined K_WINDOWS
+    WSABUF bufs[MAX_IO_BUFFERS];
+    for (int i = 0; i < count; ++i) {
+        bufs[i].buf = buffers[i].data;
+        bufs[i].len = (ULONG)buffer_size(buffers[i]);
+    }
+
+    DWORD received = 0;
+    DWORD flags = 0;
+    return 0 == WSARecv(s, bufs, count, &received, &flags, nullptr, nullptr) ? (int)received : -1;
+#elif defined K_LINUX
+    iovec iovs[MAX_IO_BUFFERS];
+    for (int i = 0; i < count; ++i) {
+        iovs[i].iov_base = buffers[i].data;
+        iovs[i].iov_len = buffer_size(buffers[i]);
+    }
+
+    msghdr msg = {0};
+    msg.msg_iov = iovs;
+    msg.msg_iovlen = count;
+    return (int)::recvmsg(s, &msg, 0);
+#endif
+}
+
+static bool is_uring(const tcp_data* data) {
+    return event_loop::BACKEND_IO_URING == data->loop->backend();
+}
+
+static void update_events(tcp_data* data) {
+    unsigned events = event_loop::IO_NONE;
+    if (data->on_input || !data->recv_requests.empty() || (data->recv_waiters && !data->readable)) {
+        events |= event_loop::IO_READ;
+    }
+
+    if ((data->output.size() && !data->holding) || (data->send_waiters && !data->writable)) {
+        events |= event_loop::IO_WRITE;
+    }
+
+    if (data->events != events) {
+        data->events = events;
+        data->loop->modify(data->connect_socket, events);
+    }
+}
+
+// io_uring keeps one multishot recv armed while input is wanted, pull mode
+// pauses it once the read ahead piles up and resumes it below half of that.
+static void update_receive(tcp_data* data) {
+    int limit = data->receiving ? INPUT_QUEUE_LIMIT : INPUT_QUEUE_LIMIT / 2;
+    bool receiving = !data->input_closed && (data->on_input || (data->pulling && data->input.size() < limit));
+    if (data->receiving != receiving) {
+        data->receiving = receiving;
+        data->loop->receive(data->connect_socket, receiving);
+    }
+}
+
+static void submit_output(tcp_data* data) {
+    int size = data->output.size();
+    if (data->sending || !size || data->holding) {
+        return;
+    }
+
+    std::string buffer(size, '\0');
+    data->output.take(&buffer[0], size, false);
+    data->sending = data->loop->send(data->connect_socket, std::move(buffer));
+}
+
+static bool is_deferred(const tcp_data* data) {
+    return 0 < data->flush_size || 0 < data->flush_delay;
+}
+
+static void release_output(tcp_data* data, bool timer) {
+    std::lock_guard<std::mutex> lock(data->mutex);
+    if (timer) {
+        data->flush_timer = 0;
+    }
+
+    if (!data->holding || INVALID_SOCKET == data->connect_socket) {
+        return;
+    }
+
+    data->holding = false;
+    if (is_uring(data)) {
+        submit_output(data);
+    } else {
+        update_events(data);
+    }
+}
+
+// deferred output starting on an empty queue is held until flush_size bytes wait or
+// flush_delay passed, then the loop writes all of it at once. a timer still pending
+// from an earlier hold is kept and lets the new one go a little early.
+static void hold_output(tcp_data* data, bool fresh) {
+    if (0 < data->flush_size && data->flush_size <= data->output.size()) {
+        data->holding = false;
+        return;
+    }
+
+    if (!fresh || data->holding) {
+        return;
+    }
+
+    data->holding = true;
+    if (0 < data->flush_delay) {
+        if (!data->flush_timer) {
+            data->flush_timer = data->loop->add_timer(std::chrono::microseconds(data->flush_delay),
+                                                      std::bind(&release_output, data, true));
+        }
+    } else {
+        std::weak_ptr<tcp_data> self = data->self;
+        data->loop->post([self] {
+            if (std::shared_ptr<tcp_data> data = self.lock()) {
+                release_output(data.get(), false);
+            }
+        });
+    }
+}
+
+// sends what goes out at once and queues the rest, returns the size queued or -1
+static int start_output(tcp_data* data, const endpoint::const_buffer* buffers, int count, int size) {
+    // loop threads leave io_uring sends to the ring, batched with the rest of the iteration
+    bool uring = is_uring(data);
+    bool deferred = is_deferred(data);
+    bool fresh = !data->output.size() && !data->sending;
+    int sent = 0;
+    if (fresh && !deferred && !(uring && data->loop->in_loop_thread())) {
+        sent = send_buffers(data->connect_socket, buffers, count);
+        if (sent < 0) {
+            if (!would_block()) {
+                return -1;
+            }
+            sent = 0;
+        }
+
+        if (size == sent) {
+            return 0;
+        }
+    }
+
+    for (int i = 0, skip = sent; i < count; ++i) {
+        int piece = buffer_size(buffers[i]);
+        if (skip < piece) {
+            data->output.put(buffers[i].data + skip, piece - skip);
+        }
+        skip = std::max(0, skip - piece);
+    }
+
+    data->output_queued += size - sent;
+    if (deferred) {
+        hold_output(data, fresh);
+    }
+
+    if (uring) {
+        submit_output(data);
+    } else {
+        update_events(data);
+    }
+
+    return size - sent;
+}
+
+static void finish_sends(tcp_data* data, std::vector<event_loop::task>& done) {
+    while (!data->send_requests.empty() && data->send_requests.front().mark <= data->output_sent) {
+        send_request& request = data->send_requests.front();
+        if (request.notify) {
+            done.push_back(std::bind(request.notify, request.size));
+        }
+        data->send_requests.pop_front();
+    }
+}
+
+// fills pending async_recv buffers from the socket, or from the read ahead on io_uring,
+// returns false once the connection turns out to be lost.
+static bool finish_recvs(tcp_data* data, std::vector<event_loop::task>& done) {
+    bool uring = is_uring(data);
+    while (!data->recv_requests.empty()) {
+        recv_request& request = data->recv_requests.front();
+        int res = 0;
+        if (uring) {
+            if (!data->input.size()) {
+                break;
+            }
+            res = data->input.take(request.buffer, request.size, false);
+        } else {
+            res = ::recv(data->connect_socket, request.buffer, request.size, 0);
+            if (res < 0 && would_block()) {
+                break;
+            }
+        }
+
+        done.push_back(std::bind(request.notify, res));
+        data->recv_requests.pop_front();
+        if (res <= 0) {
+            return false;
+        }
+    }
+
+    if (uring) {
+        update_receive(data);
+        return data->recv_requests.empty() || data->input.size() || !data->input_closed;
+    }
+
+    return true;
+}
+
+// sends as one piece once the queued output is gone, for packets and passed fds that
+// must not be split. loop threads cannot wait and fail instead of blocking.
+static int send_whole(tcp_data* data, std::unique_lock<std::mutex>& lock, socket_t connect_socket,
+                      function_ref<int()> send_once) {
+    while (connect_socket == data->connect_socket) {
+        if (!data->output.size() && !data->sending) {
+            int res = send_once();
+            if (0 <= res || !would_block()) {
+                return res;
+            }
+            data->writable = false;
+        }
+
+        if (data->loop->in_loop_thread()) {
+            return -1;
+        }
+
+        ++data->send_waiters;
+        update_events(data);
+        data->cond.wait(lock, [data, connect_socket] {
+            return (data->writable && !data->output.size()) || connect_socket != data->connect_socket;
+        });
+        --data->send_waiters;
+    }
+
+    return -1;
+}
+
+static void wait_readable(tcp_data* data, std::unique_lock<std::mutex>& lock, socket_t connect_socket) {
+    ++data->recv_waiters;
+    update_events(data);
+    data->cond.wait(lock, [data, connect_socket] {
+        return data->readable || connect_socket != data->connect_socket;
+    });
+    --data->recv_waiters;
+}
+
+static void run_tasks(std::vector<event_loop::task>& done) {
+    for (event_loop::task& t : done) {
+        t();
+    }
+    done.clear();
+}
+
+tcp::tcp(const std::string& info) : endpoint(info), m_data(new tcp_data) {
+    socket_data::init();
+    m_data->loop = event_loop::pick();
+    m_data->self.reset(m_data, [](tcp_data*) {});
+}
+
+tcp::tcp(const std::string& info, int family) : tcp(info) {
+    m_data->family = family;
+}
+
+tcp::~tcp() {
+    close();
+
+    // tasks posted before the disconnect may still use the data
+    tcp_data* data = m_data;
+    data->loop->sync([data] { delete data; });
+}
+
+bool tcp::listen(connected_notify notify) {
+    m_data->on_connected = notify;
+    m_data->on_session = nullptr;
+    return open_listener();
+}
+
+bool tcp::connect(const std::string& remote_info, connected_notify notify) {
+    pending_connect pending;
+    if (!fill_address(pending.remote_addr, m_data->family, remote_info)) {
+        return false;
+    }
+
+    pending.connect_socket = socket(m_data->family, m_data->type, 0);
+    if (INVALID_SOCKET == pending.connect_socket) {
+        return false;
+    }
+
+    if (0 != ::connect(pending.connect_socket, pending.remote_addr.get(), pending.remote_addr.size)) {
+        closesocket(pending.connect_socket);
+        return false;
+    }
+
+    if (!attach_connected(pending)) {
+        return false;
+    }
+
+    if (notify) {
+        notify();
+    }
+
+    return true;
+}
+
+bool tcp::async_connect(const std::string& remote_info, completion_notify notify) {
+    pending_connect pending;
+    if (!notify || !fill_address(pending.remote_addr, m_data->family, remote_info)) {
+        return false;
+    }
+
+    pending.connect_socket = socket(m_data->family, m_data->type, 0);
+    if (INVALID_SOCKET == pending.connect_socket) {
+        return false;
+    }
+
+    if (!set_nonblocking(pending.connect_socket) ||
+        (0 != ::connect(pending.connect_socket, pending.remote_addr.get(), pending.remote_addr.size) && !connect_pending())) {
+        closesocket(pending.connect_socket);
+        return false;
+    }
+
+    disconnect();
+
+    // the handler waits for the lock, so it never sees the connect half recorded
+    std::lock_guard<std::mutex> lock(m_data->mutex);
+    if (!m_data->loop->attach(pending.connect_socket, event_loop::IO_WRITE, [this, pending](unsigned events) {
+            connect_handler(pending);
+        })) {
+        closesocket(pending.connect_socket);
+        return false;
+    }
+
+    m_data->connecting_socket = pending.connect_socket;
+    m_data->on_connect = notify;
+    return true;
+}
+
+bool tcp::is_listening() const {
+    return INVALID_SOCKET != m_data->listen_socket;
+}
+
+bool tcp::is_connected() const {
+    return INVALID_SOCKET != m_data->connect_socket;
+}
+
+void tcp::disconnect() {
+    socket_t connect_socket = INVALID_SOCKET;
+    socket_t connecting_socket = INVALID_SOCKET;
+    completion_notify on_connect;
+    event_loop::timer_id flush_timer = 0;
+    std::deque<recv_request> recv_requests;
+    std::deque<send_request> send_requests;
+    {
+        std::lock_guard<std::mutex> lock(m_data->mutex);
+        // held output still gets one try, what does not fit now is dropped
+        if (m_data->holding && !m_data->sending && INVALID_SOCKET != m_data->connect_socket) {
+            m_data->holding = false;
+            flush_output();
+        }
+
+        std::swap(flush_timer, m_data->flush_timer);
+        std::swap(connect_socket, m_data->connect_socket);
+        std::swap(connecting_socket, m_data->connecting_socket);
+        on_connect.swap(m_data->on_connect);
+        m_data->events = event_loop::IO_NONE;
+        m_data->recv_requests.swap(recv_requests);
+        m_data->send_requests.swap(send_requests);
+        m_data->cond.notify_all();
+    }
+
+    // the timer takes the lock, so it is cancelled outside of it
+    if (flush_timer) {
+        m_data->loop->cancel_timer(flush_timer);
+    }
+
+    if (INVALID_SOCKET != connect_socket) {
+        m_data->loop->detach(connect_socket);
+        closesocket(connect_socket);
+    }
+
+    if (INVALID_SOCKET != connecting_socket) {
+        m_data->loop->detach(connecting_socket);
+        closesocket(connecting_socket);
+        m_data->loop->post(std::bind(on_connect, 0));
+    }
+
+    if (!recv_requests.empty() || !send_requests.empty()) {
+        m_data->loop->post([recv_requests, send_requests] {
+            for (const recv_request& request : recv_requests) {
+                request.notify(0);
+            }
+
+            for (const send_request& request : send_requests) {
+                if (request.notify) {
+                    request.notify(-1);
+                }
+            }
+        });
+    }
+}
+
+void tcp::close() {
+    disconnect();
+
+    if (m_data->broadcast_timer) {
+        m_data->loop->cancel_timer(m_data->broadcast_timer);
+        m_data->broadcast_timer = 0;
+    }
+
+    if (INVALID_SOCKET != m_data->broadcast_socket) {
+        closesocket(m_data->broadcast_socket);
+        m_data->broadcast_socket = INVALID_SOCKET;
+    }
+
+    if (is_listening()) {
+        socket_t listen_socket = m_data->listen_socket;
+        m_data->listen_socket = INVALID_SOCKET;
+        m_data->loop->detach(listen_socket);
+        closesocket(listen_socket);
+
+        // a later listener may have bound the path since, its socket stays
+        unsigned long long dev = 0, ino = 0;
+        socket_address local_addr;
+        if (fill_address(local_addr, m_data->family, m_info) && is_path(local_addr) &&
+            socket_file_id(m_info.c_str(), dev, ino) && dev == m_data->path_dev && ino == m_data->path_ino) {
+            std::remove(m_info.c_str());
+        }
+    }
+
+    for (const listener_shard& shard : m_data->shards) {
+        shard.loop->detach(shard.listen_socket);
+        closesocket(shard.listen_socket);
+    }
+    m_data->shards.clear();
+}
+
+int tcp::send(const char* buffer, int size) {
+    const_buffer buffers[] = {{buffer, buffer ? size : 0}};
+    return sendv(buffers, 1);
+}
+
+int tcp::recv(char* buffer, int size) {
+    mutable_buffer buffers[] = {{buffer, buffer ? size : 0}};
+    return recvv(buffers, 1);
+}
+
+int tcp::sendv(const const_buffer* buffers, int count) {
+    int size = total_size(buffers, count);
+    if (size <= 0) {
+        return 0;
+    }
+
+    std::unique_lock<std::mutex> lock(m_data->mutex);
+    socket_t connect_socket = m_data->connect_socket;
+    if (INVALID_SOCKET == connect_socket) {
+        return 0;
+    }
+
+    if (SOCK_SEQPACKET == m_data->type) {
+        return send_whole(m_data, lock, connect_socket, [connect_socket, buffers, count] {
+            return send_buffers(connect_socket, buffers, count);
+        });
+    }
+
+    int queued = start_output(m_data, buffers, count, size);
+    if (queued <= 0 || m_data->loop->in_loop_thread()) {
+        return queued < 0 ? -1 : size;
+    }
+
+    // deferred output is done once queued, like bytes in the socket buffer
+    if (is_deferred(m_data)) {
+        m_data->cond.wait(lock, [this, connect_socket] {
+            return m_data->output.size() <= OUTPUT_QUEUE_LIMIT || connect_socket != m_data->connect_socket;
+        });
+
+        return connect_socket == m_data->connect_socket ? size : -1;
+    }
+
+    long long mark = m_data->output_queued;
+    m_data->cond.wait(lock, [this, connect_socket, mark] {
+        return mark <= m_data->output_sent || connect_socket != m_data->connect_socket;
+    });
+
+    return mark <= m_data->output_sent ? size : -1;
+}
+
+int tcp::recvv(const mutable_buffer* buffers, int count) {
+    if (total_size(buffers, count) <= 0) {
+        return 0;
+    }
+
+    std::unique_lock<std::mutex> lock(m_data->mutex);
+    if (is_uring(m_data)) {
+        socket_t connect_socket = m_data->connect_socket;
+        if (INVALID_SOCKET == connect_socket) {
+            return 0;
+        }
+
+        m_data->pulling = true;
+        update_receive(m_data);
+        m_data->cond.wait(lock, [this, connect_socket] {
+            return m_data->input.size() || m_data->input_closed || connect_socket != m_data->connect_socket;
+        });
+
+        if (connect_socket != m_data->connect_socket) {
+            return 0;
+        }
+
+        if (m_data->input.size()) {
+            int res = 0;
+            for (int i = 0; i < count && m_data->input.size(); ++i) {
+                if (buffer_size(buffers[i])) {
+                    res += m_data->input.take(buffers[i].data, buffers[i].size, false);
+                }
+            }
+            update_receive(m_data);
+            return res;
+        }
+
+        int res = m_data->input_result;
+        lock.unlock();
+        disconnect();
+        return res < 0 ? -1 : 0;
     }
-}
 
-static std::string get_info(const sockaddr_in& addr) {
-    char buffer[INET_ADDRSTRLEN];
-    inet_ntop(AF_INET, &addr.sin_addr, buffer, sizeof(buffer));
-    return buffer + (':' + std::to_string(ntohs(addr.sin_port)));
-}
+    while (true) {
+        socket_t connect_socket = m_data->connect_socket;
+        if (INVALID_SOCKET == connect_socket) {
+            return 0;
+        }
 
-tcp::tcp(const std::string& info) : endpoint(info), m_data(new tcp_data) {
-    socket_data::init();
+        m_data->readable = false;
+        int res = recv_buffers(connect_socket, buffers, count);
+        if (0 < res) {
+            return res;
+        }
+
+        if (res < 0 && would_block()) {
+            wait_readable(m_data, lock, connect_socket);
+            continue;
+        }
+
+        lock.unlock();
+        disconnect();
+        return res;
+    }
 }
 
-tcp::~tcp() {
-    close();
-    delete m_data;
+bool tcp::async_send(const char* buffer, int size, completion_notify notify) {
+    if (!buffer || size <= 0) {
+        return false;
+    }
+
+    const_buffer buffers[] = { { buffer, size } };
+    return async_sendv(buffers, 1, notify);
 }
 
-bool tcp::listen(connected_notify notify) {
-    m_data->listen_socket = socket(AF_INET, SOCK_STREAM, 0);
-    if (INVALID_SOCKET == m_data->listen_socket) {
-        close();
+bool tcp::async_sendv(const const_buffer* buffers, int count, completion_notify notify) {
+    int size = total_size(buffers, count);
+    if (size <= 0) {
         return false;
     }
 
-    sockaddr_in local_addr = {0};
-    fill_sockaddr(local_addr, m_info);
-    if (0 != bind(m_data->listen_socket, (sockaddr*)&local_addr, sizeof(sockaddr_in))) {
-        close();
+    // packets would run together in the output queue
+    std::lock_guard<std::mutex> lock(m_data->mutex);
+    if (INVALID_SOCKET == m_data->connect_socket || SOCK_SEQPACKET == m_data->type) {
         return false;
-    };
+    }
 
-    if (0 != ::listen(m_data->listen_socket, SOMAXCONN)) {
-        close();
+    int queued = start_output(m_data, buffers, count, size);
+    if (queued < 0) {
         return false;
     }
 
-    m_info = get_info(local_addr);
+    if (!queued) {
+        if (notify) {
+            m_data->loop->post(std::bind(notify, size));
+        }
+        return true;
+    }
 
-    m_data->listen_future = std::async(std::launch::async, [this, notify] {
-        sockaddr_in remote_addr = {0};
-        socklen_t addr_len = sizeof(sockaddr_in);
-        while (true) {
-            socket_t connect_socket = accept(m_data->listen_socket, (sockaddr*)&remote_addr, &addr_len);
-            if (INVALID_SOCKET == connect_socket) {
-                break;
-            }
+    m_data->send_requests.push_back({ m_data->output_queued, size, notify });
+    return true;
+}
 
-            if (is_connected()) {
-                closesocket(connect_socket);
-                continue;
-            }
+bool tcp::async_recv(char* buffer, int size, completion_notify notify) {
+    if (!buffer || size <= 0 || !notify) {
+        return false;
+    }
 
-            m_data->connect_socket = connect_socket;
-            m_remote_info = get_info(remote_addr);
-            if (notify) {
-                notify();
-            }
+    std::vector<event_loop::task> done;
+    bool lost = false;
+    {
+        std::lock_guard<std::mutex> lock(m_data->mutex);
+        if (INVALID_SOCKET == m_data->connect_socket || m_data->on_input) {
+            return false;
         }
-    });
 
-    if (INADDR_LOOPBACK != local_addr.sin_addr.s_addr) {
-        m_data->broadcast_future = std::async(std::launch::async, &tcp::broadcast, this);
+        m_data->recv_requests.push_back({ buffer, size, notify });
+        if (is_uring(m_data)) {
+            m_data->pulling = true;
+            lost = !finish_recvs(m_data, done);
+        } else {
+            update_events(m_data);
+        }
+    }
+
+    for (event_loop::task& t : done) {
+        m_data->loop->post(t);
+    }
+
+    if (lost) {
+        disconnect();
     }
 
     return true;
 }
 
-bool tcp::connect(const std::string& remote_info, connected_notify notify) {
-    m_data->connect_socket = socket(AF_INET, SOCK_STREAM, 0);
-    if (INVALID_SOCKET == m_data->connect_socket) {
-        disconnect();
+void tcp::post(std::function<void()> task) {
+    m_data->loop->post(task);
+}
+
+bool tcp::serve(session_notify notify) {
+    if (!notify) {
         return false;
     }
 
-    sockaddr_in remote_addr = {0};
-    fill_sockaddr(remote_addr, remote_info);
-    if (0 != ::connect(m_data->connect_socket, (sockaddr*)&remote_addr, sizeof(sockaddr_in))) {
-        disconnect();
+    m_data->on_connected = nullptr;
+    m_data->on_session = notify;
+    return open_listener();
+}
+
+bool tcp::set_option(endpoint_option option, int value) {
+    if (is_listening() || is_connected()) {
         return false;
     }
 
-    sockaddr_in local_addr = {0};
-    socklen_t addr_len = sizeof(sockaddr_in);
-    if (0 != getsockname(m_data->connect_socket, (sockaddr*)&local_addr, &addr_len)) {
-        disconnect();
+    switch (option) {
+    case OPTION_BACKEND:
+        if (BACKEND_SOCKET != value && BACKEND_IO_URING != value) {
+            return false;
+        }
+
+        m_data->backend = (endpoint_backend)value;
+        m_data->loop = event_loop::pick(loop_backend(m_data));
+        return true;
+    case OPTION_SHARDS:
+        if (value < 1) {
+            return false;
+        }
+
+        m_data->shard_count = value;
+        return true;
+    case OPTION_PIN_CORES:
+        m_data->pin_cores = 0 != value;
+        return true;
+    case OPTION_SEQPACKET:
+#if defined K_LINUX
+        if (AF_UNIX == m_data->family) {
+            m_data->type = value ? SOCK_SEQPACKET : SOCK_STREAM;
+            return true;
+        }
+#endif
         return false;
+    case OPTION_FLUSH_SIZE:
+        if (value < 0) {
+            return false;
+        }
+
+        m_data->flush_size = value;
+        return true;
+    case OPTION_FLUSH_DELAY:
+        if (value < 0) {
+            return false;
+        }
+
+        m_data->flush_delay = value;
+        return true;
+    default:
+        break;
+    }
+
+    return false;
+}
+
+void tcp::set_input(input_notify notify) {
+    std::lock_guard<std::mutex> lock(m_data->mutex);
+    m_data->on_input = notify;
+    if (!is_connected()) {
+        return;
+    }
+
+    if (is_uring(m_data)) {
+        update_receive(m_data);
+    } else {
+        update_events(m_data);
+    }
+}
+
+bool tcp::open_listener() {
+    // listen takes a single peer, only serve is worth sharding
+    int shard_count = 1;
+    bool sharded = m_data->on_session && (1 < m_data->shard_count || m_data->pin_cores);
+#if defined SO_REUSEPORT
+    if (m_data->on_session && AF_INET == m_data->family) {
+        shard_count = m_data->shard_count;
+    }
+#endif
+
+    socket_address local_addr;
+    if (!fill_address(local_addr, m_data->family, m_info)) {
+        return false;
+    }
+
+    if (sharded) {
+        m_data->loop = event_loop::shard(0, loop_backend(m_data), m_data->pin_cores);
+    }
+
+    m_data->listen_socket = open_listen_socket(m_data, local_addr, 1 < shard_count);
+    if (is_path(local_addr) && INVALID_SOCKET != m_data->listen_socket) {
+        socket_file_id(((sockaddr_un*)&local_addr.storage)->sun_path, m_data->path_dev, m_data->path_ino);
+    }
+
+    if (INVALID_SOCKET == m_data->listen_socket ||
+        !attach_listener({m_data->loop, m_data->listen_socket, sharded ? m_data->loop : nullptr})) {
+        close();
+        return false;
+    }
+
+    // the first listener settled the port, the others join it
+    for (int i = 1; i < shard_count; ++i) {
+        event_loop* loop = event_loop::shard(i, loop_backend(m_data), m_data->pin_cores);
+        listener_shard shard = {loop, open_listen_socket(m_data, local_addr, true), loop};
+        if (INVALID_SOCKET == shard.listen_socket) {
+            close();
+            return false;
+        }
+
+        m_data->shards.push_back(shard);
+        if (!attach_listener(shard)) {
+            close();
+            return false;
+        }
     }
 
     m_info = get_info(local_addr);
-    m_remote_info = get_info(remote_addr);
 
-    if (notify) {
-        notify();
+    if (AF_INET == m_data->family && INADDR_LOOPBACK != ((sockaddr_in*)&local_addr.storage)->sin_addr.s_addr) {
+        m_data->broadcast_addrs = get_broadcast_addrs();
+        if (!m_data->broadcast_addrs.empty()) {
+            m_data->broadcast_socket = socket(AF_INET, SOCK_DGRAM, 0);
+        }
+
+        if (INVALID_SOCKET != m_data->broadcast_socket) {
+            int opt = 1;
+            setsockopt(m_data->broadcast_socket, SOL_SOCKET, SO_BROADCAST, (char*)&opt, sizeof(opt));
+
+            char name[256] = {0};
+            gethostname(name, sizeof(name));
+            m_data->broadcast_name = name;
+
+            broadcast();
+            m_data->broadcast_timer = m_data->loop->add_timer(std::chrono::seconds(BROADCAST_INTERVAL),
+                                                              std::bind(&tcp::broadcast, this), true);
+        }
     }
 
     return true;
 }
 
-bool tcp::is_listening() const {
-    return INVALID_SOCKET != m_data->listen_socket;
+bool tcp::attach_stream() {
+    std::lock_guard<std::mutex> lock(m_data->mutex);
+    m_data->events = event_loop::IO_NONE;
+    m_data->readable = m_data->writable = false;
+    m_data->output.reset();
+    m_data->output_queued = m_data->output_sent = 0;
+    m_data->holding = false;
+    m_data->on_input = nullptr;
+    m_data->input.reset();
+    m_data->pulling = m_data->receiving = m_data->input_closed = m_data->sending = false;
+    m_data->input_result = 0;
+
+    if (!set_nonblocking(m_data->connect_socket)) {
+        return false;
+    }
+
+    if (is_uring(m_data)) {
+        return m_data->loop->attach(m_data->connect_socket, [this](event_loop::io_completion completion, int res, char* buffer) {
+            completion_handler(completion, res, buffer);
+        });
+    }
+
+    return m_data->loop->attach(m_data->connect_socket, m_data->events, [this](unsigned events) {
+        stream_handler(events);
+    });
 }
 
-bool tcp::is_connected() const {
-    return INVALID_SOCKET != m_data->connect_socket;
+bool tcp::attach_listener(const listener_shard& listener) {
+    if (event_loop::BACKEND_IO_URING == listener.loop->backend()) {
+        event_loop* session_loop = listener.session_loop;
+        return listener.loop->attach(listener.listen_socket, [this, session_loop](event_loop::io_completion completion, int res, char* buffer) {
+            socket_address remote_addr;
+            getpeername((socket_t)res, remote_addr.get(), &remote_addr.size);
+            accept_stream({(socket_t)res, get_info(remote_addr), session_loop});
+        }) && listener.loop->accept(listener.listen_socket);
+    }
+
+    return set_nonblocking(listener.listen_socket) &&
+           listener.loop->attach(listener.listen_socket, event_loop::IO_READ, [this, listener](unsigned events) {
+               accept_handler(listener);
+           });
 }
 
-void tcp::disconnect() {
-    if (is_connected()) {
-        closesocket(m_data->connect_socket);
-        m_data->connect_socket = INVALID_SOCKET;
+void tcp::accept_handler(const listener_shard& listener) {
+    while (true) {
+        socket_address remote_addr;
+        socket_t connect_socket = accept(listener.listen_socket, remote_addr.get(), &remote_addr.size);
+        if (INVALID_SOCKET == connect_socket) {
+            break;
+        }
+
+        accept_stream({connect_socket, get_info(remote_addr), listener.session_loop});
     }
 }
 
-void tcp::close() {
-    disconnect();
+// takes over a socket whose connect went through
+bool tcp::attach_connected(const pending_connect& pending) {
+    socket_address local_addr;
+    if (0 != getsockname(pending.connect_socket, local_addr.get(), &local_addr.size)) {
+        closesocket(pending.connect_socket);
+        return false;
+    }
 
-    if (is_listening()) {
-        closesocket(m_data->listen_socket);
-        m_data->listen_socket = INVALID_SOCKET;
+    disconnect();
+    m_data->connect_socket = pending.connect_socket;
+    if (!attach_stream()) {
+        disconnect();
+        return false;
     }
 
-    m_data->m_cond_closed.notify_all();
+    m_info = get_info(local_addr);
+    m_remote_info = get_info(pending.remote_addr);
+    return true;
 }
 
-int tcp::send(const char* buffer, int size) {
-    if (!is_connected()) {
-        return 0;
+// the socket of an async_connect turned writable, it either connected or failed
+void tcp::connect_handler(const pending_connect& pending) {
+    completion_notify notify;
+    {
+        std::lock_guard<std::mutex> lock(m_data->mutex);
+        if (pending.connect_socket != m_data->connecting_socket) {
+            return;
+        }
+
+        m_data->connecting_socket = INVALID_SOCKET;
+        notify.swap(m_data->on_connect);
+    }
+
+    m_data->loop->detach(pending.connect_socket);
+
+    int error = 0;
+    socklen_t size = sizeof(error);
+    if (0 != getsockopt(pending.connect_socket, SOL_SOCKET, SO_ERROR, (char*)&error, &size) || error) {
+        closesocket(pending.connect_socket);
+        notify(0);
+        return;
     }
 
-    return ::send(m_data->connect_socket, buffer, size, 0);
+    notify(attach_connected(pending) ? 1 : 0);
 }
 
-int tcp::recv(char* buffer, int size) {
-    if (!is_connected()) {
-        return 0;
+void tcp::accept_stream(const accepted_stream& stream) {
+    if (m_data->on_session) {
+        tcp* session = new_session();
+        session->m_data->type = m_data->type;
+        session->m_data->flush_size = m_data->flush_size;
+        session->m_data->flush_delay = m_data->flush_delay;
+        session->set_option(OPTION_BACKEND, m_data->backend);
+        if (stream.loop) {
+            session->m_data->loop = stream.loop;
+        }
+        session->m_data->connect_socket = stream.connect_socket;
+        if (!session->attach_stream()) {
+            delete session;
+            return;
+        }
+
+        session->m_remote_info = stream.remote_info;
+        m_data->on_session(session);
+        return;
+    }
+
+    if (is_connected()) {
+        closesocket(stream.connect_socket);
+        return;
     }
 
-    int res = ::recv(m_data->connect_socket, buffer, size, 0);
-    if (res <= 0) {
+    m_data->connect_socket = stream.connect_socket;
+    if (!attach_stream()) {
         disconnect();
+        return;
     }
 
-    return res;
+    m_remote_info = stream.remote_info;
+    if (m_data->on_connected) {
+        m_data->on_connected();
+    }
 }
 
-void tcp::broadcast() {
-    std::vector<in_addr> sin_addrs;
-#if defined K_WINDOWS
-    ULONG size = 0;
-    GetAdaptersInfo(nullptr, &size);
-    if (!size) {
+void tcp::stream_handler(unsigned events) {
+    static thread_local char buffer[INPUT_BUFFER_SIZE];
+
+    socket_t connect_socket = INVALID_SOCKET;
+    bool lost = false;
+    bool input = false;
+    std::vector<event_loop::task> done;
+    {
+        std::lock_guard<std::mutex> lock(m_data->mutex);
+        connect_socket = m_data->connect_socket;
+        if (INVALID_SOCKET == connect_socket) {
+            return;
+        }
+
+        if (events & (event_loop::IO_WRITE | event_loop::IO_ERROR)) {
+            lost = !flush_output();
+            finish_sends(m_data, done);
+            m_data->writable = true;
+            m_data->cond.notify_all();
+        }
+
+        if (events & (event_loop::IO_READ | event_loop::IO_ERROR)) {
+            m_data->readable = true;
+            m_data->cond.notify_all();
+            lost = lost || !finish_recvs(m_data, done);
+        }
+
+        input = !lost && m_data->on_input;
+        update_events(m_data);
+
+        if ((events & event_loop::IO_ERROR) && !lost && event_loop::IO_NONE == m_data->events) {
+            m_data->loop->detach(connect_socket);
+        }
+    }
+
+    run_tasks(done);
+    if (input && (events & (event_loop::IO_READ | event_loop::IO_ERROR))) {
+        int res = ::recv(connect_socket, buffer, INPUT_BUFFER_SIZE, 0);
+        if (0 < res) {
+            m_data->on_input(buffer, res);
+            return;
+        }
+
+        lost = res == 0 || !would_block();
+    }
+
+    if (lost) {
+        disconnect();
+        if (m_data->on_input) {
+            m_data->on_input(nullptr, 0);
+        }
+    }
+}
+
+void tcp::completion_handler(int completion, int res, char* buffer) {
+    if (event_loop::IO_RECEIVED == completion && 0 < res && m_data->on_input) {
+        m_data->on_input(buffer, res);
         return;
     }
 
-    PIP_ADAPTER_INFO infos = (PIP_ADAPTER_INFO) new char[size];
-    if (ERROR_SUCCESS == GetAdaptersInfo(infos, &size)) {
-        for (PIP_ADAPTER_INFO info = infos; info; info = info->Next) {
-            for (PIP_ADDR_STRING string = &info->IpAddressList; string; string = string->Next) {
-                in_addr address;
-                inet_pton(AF_INET, string->IpAddress.String, &address);
-                if (INADDR_ANY != address.s_addr && INADDR_LOOPBACK != address.s_addr) {
-                    in_addr mask, broadcast;
-                    inet_pton(AF_INET, string->IpMask.String, &mask);
-                    broadcast.s_addr = address.s_addr | ~mask.s_addr;
-                    sin_addrs.push_back(broadcast);
-                }
+    std::vector<event_loop::task> done;
+    bool lost = false;
+    {
+        std::lock_guard<std::mutex> lock(m_data->mutex);
+        if (INVALID_SOCKET == m_data->connect_socket) {
+            return;
+        }
+
+        if (event_loop::IO_SENT == completion) {
+            m_data->sending = false;
+            if (0 < res) {
+                m_data->output_sent += res;
+                submit_output(m_data);
+                finish_sends(m_data, done);
+            }
+        } else {
+            if (0 < res) {
+                m_data->input.put(buffer, res);
+            } else {
+                m_data->input_closed = true;
+                m_data->input_result = res;
             }
+            m_data->receiving = m_data->receiving && 0 < res;
+            lost = !finish_recvs(m_data, done);
         }
+        m_data->cond.notify_all();
     }
 
-    delete[] (char*)infos;
-#elif defined K_LINUX
-    ifaddrs* ifas = nullptr;
-    if (0 == getifaddrs(&ifas)) {
-        for (ifaddrs* ifa = ifas; ifa; ifa = ifa->ifa_next) {
-            if ((IFF_BROADCAST & ifa->ifa_flags) && ifa->ifa_broadaddr && AF_INET == ifa->ifa_broadaddr->sa_family) {
-                sin_addrs.push_back(((sockaddr_in*)ifa->ifa_broadaddr)->sin_addr);
+    run_tasks(done);
+
+    // pull mode finds out about eof once recv drained what came before it
+    if (!lost && (0 < res || (!m_data->on_input && event_loop::IO_RECEIVED == completion))) {
+        return;
+    }
+
+    disconnect();
+    if (m_data->on_input) {
+        m_data->on_input(nullptr, 0);
+    }
+}
+
+tcp* tcp::new_session() const {
+    return new tcp(m_info);
+}
+
+int tcp::send_with_fds(const char* buffer, int size, const int* fds, int count) {
+#if defined K_LINUX
+    if (!buffer || size <= 0 || !fds || count <= 0 || MAX_PASSED_FDS < count || AF_UNIX != m_data->family) {
+        return -1;
+    }
+
+    std::unique_lock<std::mutex> lock(m_data->mutex);
+    socket_t connect_socket = m_data->connect_socket;
+    if (INVALID_SOCKET == connect_socket) {
+        return 0;
+    }
+
+    int res = send_whole(m_data, lock, connect_socket, [connect_socket, buffer, size, fds, count] {
+        iovec iov = {(void*)buffer, (size_t)size};
+        char control[CMSG_SPACE(sizeof(int) * MAX_PASSED_FDS)] = {0};
+        msghdr msg = {0};
+        msg.msg_iov = &iov;
+        msg.msg_iovlen = 1;
+        msg.msg_control = control;
+        msg.msg_controllen = CMSG_SPACE(sizeof(int) * count);
+
+        cmsghdr* cmsg = CMSG_FIRSTHDR(&msg);
+        cmsg->cmsg_level = SOL_SOCKET;
+        cmsg->cmsg_type = SCM_RIGHTS;
+        cmsg->cmsg_len = CMSG_LEN(sizeof(int) * count);
+        memcpy(CMSG_DATA(cmsg), fds, sizeof(int) * count);
+        return (int)::sendmsg(connect_socket, &msg, SEND_FLAGS);
+    });
+
+    // the fds went with the first byte, a stream carries the rest as usual
+    if (res <= 0 || size == res) {
+        return res;
+    }
+
+    lock.unlock();
+    return 0 < send(buffer + res, size - res) ? size : -1;
+#else
+    return -1;
+#endif
+}
+
+int tcp::recv_with_fds(char* buffer, int size, int* fds, int* count) {
+#if defined K_LINUX
+    if (!buffer || size <= 0 || !fds || !count || *count <= 0) {
+        return -1;
+    }
+
+    int max_count = std::min(*count, MAX_PASSED_FDS);
+    *count = 0;
+
+    // pushed input and io_uring receives would have dropped the fds
+    std::unique_lock<std::mutex> lock(m_data->mutex);
+    if (m_data->on_input || is_uring(m_data)) {
+        return -1;
+    }
+
+    while (true) {
+        socket_t connect_socket = m_data->connect_socket;
+        if (INVALID_SOCKET == connect_socket) {
+            return 0;
+        }
+
+        iovec iov = {buffer, (size_t)size};
+        char control[CMSG_SPACE(sizeof(int) * MAX_PASSED_FDS)];
+        msghdr msg = {0};
+        msg.msg_iov = &iov;
+        msg.msg_iovlen = 1;
+        msg.msg_control = control;
+        msg.msg_controllen = sizeof(control);
+
+        m_data->readable = false;
+        int res = (int)::recvmsg(connect_socket, &msg, MSG_CMSG_CLOEXEC);
+        if (0 < res) {
+            for (cmsghdr* cmsg = CMSG_FIRSTHDR(&msg); cmsg; cmsg = CMSG_NXTHDR(&msg, cmsg)) {
+                if (SOL_SOCKET != cmsg->cmsg_level || SCM_RIGHTS != cmsg->cmsg_type) {
+                    continue;
+                }
+
+                const int* passed = (const int*)CMSG_DATA(cmsg);
+                int passed_count = (int)((cmsg->cmsg_len - CMSG_LEN(0)) / sizeof(int));
+                for (int i = 0; i < passed_count; ++i) {
+                    if (*count < max_count) {
+                        fds[(*count)++] = passed[i];
+                    } else {
+                        ::close(passed[i]);
+                    }
+                }
             }
+            return res;
         }
-        freeifaddrs(ifas);
+
+        if (res < 0 && would_block()) {
+            wait_readable(m_data, lock, connect_socket);
+            continue;
+        }
+
+        lock.unlock();
+        disconnect();
+        return res;
     }
+#else
+    return -1;
 #endif
+}
 
-    if (sin_addrs.empty()) {
-        return;
+bool tcp::flush_output() {
+    if (m_data->holding) {
+        return true;
     }
 
-    socket_t broadcast_socket = socket(AF_INET, SOCK_DGRAM, 0);
-    if (INVALID_SOCKET == broadcast_socket) {
-        return;
+    bool error = false;
+    int count = m_data->output.take([this, &error](char* buffer, int size) {
+        int res = ::send(m_data->connect_socket, buffer, size, SEND_FLAGS);
+        if (res < 0) {
+            error = !would_block();
+            res = 0;
+        }
+        return res;
+    }, false);
+
+    if (0 < count) {
+        m_data->output_sent += count;
+        m_data->cond.notify_all();
     }
 
-    int opt = 1;
-    setsockopt(broadcast_socket, SOL_SOCKET, SO_BROADCAST, (char*)&opt, sizeof(opt));
+    return !error;
+}
 
-    char name[256] = {0};
-    gethostname(name, sizeof(name));
-    int name_len = (int)strlen(name);
+void tcp::broadcast() {
+    if (is_connected()) {
+        return;
+    }
 
     sockaddr_in broadcast_addr = {0};
     broadcast_addr.sin_family = AF_INET;
     broadcast_addr.sin_port = htons(DEFAULT_PORT);
 
-    struct {
-        void unlock() {}
-        void lock() {}
-    } lock;
-
-    while (is_listening()) {
-        if (!is_connected()) {
-            for (in_addr sin_addr : sin_addrs) {
-                broadcast_addr.sin_addr = sin_addr;
-                sendto(broadcast_socket, name, name_len, 0, (sockaddr*)&broadcast_addr, sizeof(broadcast_addr));
-            }
-        }
-        m_data->m_cond_closed.wait_for(lock, std::chrono::seconds(BROADCAST_INTERVAL));
+    for (in_addr sin_addr : m_data->broadcast_addrs) {
+        broadcast_addr.sin_addr = sin_addr;
+        sendto(m_data->broadcast_socket, m_data->broadcast_name.data(), (int)m_data->broadcast_name.size(), 0,
+               (sockaddr*)&broadcast_addr, sizeof(broadcast_addr));
     }
-
-    closesocket(broadcast_socket);
 }
@@ -28,6 +28,9 @@
 #include "endpoint.h"
 
 class tcp : public endpoint {
+public:
+    using input_notify = std::function<void(char* buffer, int size)>;
+
 public:
     explicit tcp(const std::string& info = std::string());
     virtual ~tcp();
@@ -41,8 +44,44 @@ public:
     virtual void close() override;
     virtual int send(const char* buffer, int size) override;
     virtual int recv(char* buffer, int size) override;
+    virtual int sendv(const const_buffer* buffers, int count) override;
+    virtual int recvv(const mutable_buffer* buffers, int count) override;
+    virtual bool async_send(const char* buffer, int size, completion_notify notify) override;
+    virtual bool async_recv(char* buffer, int size, completion_notify notify) override;
+    virtual bool async_connect(const std::string& remote_info, completion_notify notify) override;
+    virtual bool serve(session_notify notify) override;
+    virtual bool set_option(endpoint_option option, int value) override;
+
+public:
+    // received bytes are pushed to notify on the event loop instead of being
+    // pulled by recv, size <= 0 means disconnected. notify may write over the
+    // bytes in place, the buffer is the transport's again once it returns.
+    virtual void set_input(input_notify notify);
+    // runs task on the event loop serving this endpoint.
+    virtual void post(std::function<void()> task);
+    // async_send of the buffers gathered, notify gets their total size.
+    virtual bool async_sendv(const const_buffer* buffers, int count, completion_notify notify);
+
+protected:
+    tcp(const std::string& info, int family);
+
+    // sessions accepted by serve are of the listener's own kind
+    virtual tcp* new_session() const;
+    // bytes carrying file descriptors, AF_UNIX on linux only
+    int send_with_fds(const char* buffer, int size, const int* fds, int count);
+    int recv_with_fds(char* buffer, int size, int* fds, int* count);
 
 private:
+    bool open_listener();
+    bool attach_listener(const struct listener_shard& listener);
+    bool attach_stream();
+    bool attach_connected(const struct pending_connect& pending);
+    void connect_handler(const struct pending_connect& pending);
+    void accept_handler(const struct listener_shard& listener);
+    void accept_stream(const struct accepted_stream& stream);
+    void stream_handler(unsigned events);
+    void completion_handler(int completion, int res, char* buffer);
+    bool flush_output();
     void broadcast();
 
 private:
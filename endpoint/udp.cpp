@@ -0,0 +1,738 @@
+/*
+  MIT License
+
+  Copyright (c) 2025 Kong Pengsheng
+
+  Permission is hereby granted, free of charge, to any person obtaining a copy
+  of this software and associated documentation files (the "Software"), to deal
+  in the Software without restriction, including without limitation the rights
+  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+  copies of the Software, and to permit persons to whom the Software is
+  furnished to do so, subject to the following conditions:
+
+  The above copyright notice and this permission notice shall be included in all
+  copies or substantial portions of the Software.
+
+  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+  SOFTWARE.
+*/
+
+#include "udp.h"
+#include "socket.h"
+#include <cstring>
+#include <cstdint>
+#include <algorithm>
+#include <mutex>
+#include <condition_variable>
+#include <vector>
+#include "endpoint_util.h"
+#include "event_loop.h"
+#if defined K_LINUX
+#include <netinet/in.h>
+#include <netinet/udp.h>
+
+#ifndef UDP_SEGMENT
+#define UDP_SEGMENT 103
+#endif
+#ifndef UDP_GRO
+#define UDP_GRO 104
+#endif
+#endif
+
+const int MAX_DATAGRAM_SIZE = 65507;
+const int MAX_IO_BUFFERS = 64;
+const int MAX_BATCH = 64;
+const int MAX_GSO_SEGMENTS = 64;
+const int MAX_GSO_SEGMENT_SIZE = 1472;
+const int GRO_BUFFER_SIZE = 65536;
+
+struct udp_data {
+    event_loop* loop = nullptr;
+    socket_t udp_socket = INVALID_SOCKET;
+    bool listening = false;
+    bool connected = false;
+    unsigned session = 0;
+    endpoint::connected_notify on_connected;
+    std::mutex mutex;
+    std::condition_variable cond;
+    unsigned events = event_loop::IO_NONE;
+    bool readable = false;
+    bool writable = false;
+    int recv_waiters = 0;
+    int send_waiters = 0;
+    bool gso = true;
+    bool gro = false;
+    std::vector<char> gro_buffer;
+    int gro_size = 0;
+    int gro_offset = 0;
+    int gro_segment = 0;
+};
+
+static int scatter(const endpoint::mutable_buffer* buffers, int count, const char* data, int size) {
+    int copied = 0;
+    for (int i = 0; i < count && copied < size; ++i) {
+        int piece = std::min(buffer_size(buffers[i]), size - copied);
+        if (0 < piece) {
+            memcpy(buffers[i].data, data + copied, piece);
+            copied += piece;
+        }
+    }
+    return copied;
+}
+
+// an icmp error of an earlier datagram, reported once and not worth failing for
+static bool was_refused() {
+#if defined K_WINDOWS
+    return WSAECONNRESET == WSAGetLastError();
+#elif defined K_LINUX
+    return ECONNREFUSED == errno;
+#endif
+}
+
+// back to no peer, datagrams from anyone get in again
+static void dissolve(socket_t s) {
+    sockaddr_in addr = {0};
+#if defined K_WINDOWS
+    addr.sin_family = AF_INET;
+#elif defined K_LINUX
+    addr.sin_family = AF_UNSPEC;
+#endif
+    ::connect(s, (sockaddr*)&addr, sizeof(addr));
+}
+
+// the first datagram names the peer, connect keeps everyone else out from then on
+static bool take_peer(socket_t s, socket_address& remote_addr) {
+    char byte = 0;
+    int res = recvfrom(s, &byte, 1, MSG_PEEK, remote_addr.get(), &remote_addr.size);
+    if (res < 0 && would_block()) {
+        return false;
+    }
+
+    if (AF_INET != remote_addr.storage.ss_family) {
+        recv(s, &byte, 1, 0);
+        return false;
+    }
+
+    return 0 == ::connect(s, remote_addr.get(), remote_addr.size);
+}
+
+static void update_events(udp_data* data) {
+    unsigned events = event_loop::IO_NONE;
+    if ((data->listening && !data->connected) || (data->recv_waiters && !data->readable)) {
+        events |= event_loop::IO_READ;
+    }
+
+    if (data->send_waiters && !data->writable) {
+        events |= event_loop::IO_WRITE;
+    }
+
+    if (events != data->events && INVALID_SOCKET != data->udp_socket) {
+        data->events = events;
+        data->loop->modify(data->udp_socket, events);
+    }
+}
+
+// loop threads cannot wait and give up instead, disconnect wakes the waiters
+static bool wait_readable(udp_data* data, std::unique_lock<std::mutex>& lock) {
+    if (data->loop->in_loop_thread()) {
+        return false;
+    }
+
+    unsigned session = data->session;
+    ++data->recv_waiters;
+    update_events(data);
+    data->cond.wait(lock, [data, session] {
+        return data->readable || session != data->session;
+    });
+    --data->recv_waiters;
+    return true;
+}
+
+static bool wait_writable(udp_data* data, std::unique_lock<std::mutex>& lock) {
+    if (data->loop->in_loop_thread()) {
+        return false;
+    }
+
+    unsigned session = data->session;
+    ++data->send_waiters;
+    update_events(data);
+    data->cond.wait(lock, [data, session] {
+        return data->writable || session != data->session;
+    });
+    --data->send_waiters;
+    return true;
+}
+
+// the rest of a coalesced receive, one datagram at a time
+static int take_segment(udp_data* data, const endpoint::mutable_buffer* buffers, int count) {
+    if (data->gro_size <= data->gro_offset) {
+        return 0;
+    }
+
+    int size = std::min(data->gro_segment, data->gro_size - data->gro_offset);
+    data->gro_offset += size;
+    return scatter(buffers, count, data->gro_buffer.data() + data->gro_offset - size, size);
+}
+
+static int send_datagram(socket_t s, const endpoint::const_buffer* buffers, int count) {
+#if defined K_WINDOWS
+    WSABUF bufs[MAX_IO_BUFFERS];
+    for (int i = 0; i < count; ++i) {
+        bufs[i].buf = (CHAR*)buffers[i].data;
+        bufs[i].len = (ULONG)buffer_size(buffers[i]);
+    }
+
+    DWORD sent = 0;
+    return 0 == WSASend(s, bufs, count, &sent, 0, nullptr, nullptr) ? (int)sent : -1;
+#elif defined K_LINUX
+    iovec iovs[MAX_IO_BUFFERS];
+    for (int i = 0; i < count; ++i) {
+        iovs[i].iov_base = (void*)buffers[i].data;
+        iovs[i].iov_len = buffer_size(buffers[i]);
+    }
+
+    msghdr msg = {0};
+    msg.msg_iov = iovs;
+    msg.msg_iovlen = count;
+    return (int)::sendmsg(s, &msg, SEND_FLAGS);
+#endif
+}
+
+static int recv_datagram(socket_t s, const endpoint::mutable_buffer* buffers, int count) {
+#if defined K_WINDOWS
+    WSABUF bufs[MAX_IO_BUFFERS];
+    for (int i = 0; i < count; ++i) {
+        bufs[i].buf = buffers[i].data;
+        bufs[i].len = (ULONG)buffer_size(buffers[i]);
+    }
+
+    // the cut off part of a longer datagram is dropped, as on linux
+    DWORD received = 0;
+    DWORD flags = 0;
+    if (0 != WSARecv(s, bufs, count, &received, &flags, nullptr, nullptr) && WSAEMSGSIZE != WSAGetLastError()) {
+        return -1;
+    }
+    return (int)received;
+#elif defined K_LINUX
+    iovec iovs[MAX_IO_BUFFERS];
+    for (int i = 0; i < count; ++i) {
+        iovs[i].iov_base = buffers[i].data;
+        iovs[i].iov_len = buffer_size(buffers[i]);
+    }
+
+    msghdr msg = {0};
+    msg.msg_iov = iovs;
+    msg.msg_iovlen = count;
+    return (int)::recvmsg(s, &msg, 0);
+#endif
+}
+
+#if defined K_LINUX
+// datagrams of one size in a row, the last may be shorter, leave as one GSO send
+// and the kernel or the nic cuts them apart again.
+static int send_many(udp_data* data, const endpoint::const_buffer* datagrams, int count) {
+    count = std::min(count, MAX_BATCH);
+    mmsghdr msgs[MAX_BATCH];
+    iovec iovs[MAX_BATCH];
+    char controls[MAX_BATCH][CMSG_SPACE(sizeof(uint16_t))];
+    int runs[MAX_BATCH];
+    int msg_count = 0;
+    for (int taken = 0; taken < count; taken += runs[msg_count++]) {
+        int size = buffer_size(datagrams[taken]);
+        int total = size;
+        int run = 1;
+        while (data->gso && 0 < size && size <= MAX_GSO_SEGMENT_SIZE && taken + run < count && run < MAX_GSO_SEGMENTS) {
+            int next = buffer_size(datagrams[taken + run]);
+            if (next <= 0 || size < next || MAX_DATAGRAM_SIZE < total + next) {
+                break;
+            }
+
+            total += next;
+            ++run;
+            if (next < size) {
+                break;
+            }
+        }
+
+        for (int i = taken; i < taken + run; ++i) {
+            iovs[i].iov_base = (void*)datagrams[i].data;
+            iovs[i].iov_len = buffer_size(datagrams[i]);
+        }
+
+        msghdr& msg = msgs[msg_count].msg_hdr;
+        msg = msghdr();
+        msg.msg_iov = &iovs[taken];
+        msg.msg_iovlen = run;
+        if (1 < run) {
+            msg.msg_control = controls[msg_count];
+            msg.msg_controllen = sizeof(controls[msg_count]);
+            cmsghdr* cmsg = CMSG_FIRSTHDR(&msg);
+            cmsg->cmsg_level = IPPROTO_UDP;
+            cmsg->cmsg_type = UDP_SEGMENT;
+            cmsg->cmsg_len = CMSG_LEN(sizeof(uint16_t));
+            uint16_t segment = (uint16_t)size;
+            memcpy(CMSG_DATA(cmsg), &segment, sizeof(segment));
+        }
+        runs[msg_count] = run;
+    }
+
+    int res = ::sendmmsg(data->udp_socket, msgs, msg_count, SEND_FLAGS);
+    if (res < 0) {
+        // kernels or devices without GSO refuse the first run, plain sends take over
+        if (1 < runs[0] && (EINVAL == errno || EIO == errno || ENOPROTOOPT == errno || EOPNOTSUPP == errno)) {
+            data->gso = false;
+            return send_many(data, datagrams, count);
+        }
+        return -1;
+    }
+
+    int sent = 0;
+    for (int i = 0; i < res; ++i) {
+        sent += runs[i];
+    }
+    return sent;
+}
+
+static int recv_many(udp_data* data, endpoint::mutable_buffer* datagrams, int count) {
+    count = std::min(count, MAX_BATCH);
+    mmsghdr msgs[MAX_BATCH];
+    iovec iovs[MAX_BATCH];
+    for (int i = 0; i < count; ++i) {
+        iovs[i].iov_base = datagrams[i].data;
+        iovs[i].iov_len = datagrams[i].size;
+        msgs[i].msg_hdr = msghdr();
+        msgs[i].msg_hdr.msg_iov = &iovs[i];
+        msgs[i].msg_hdr.msg_iovlen = 1;
+    }
+
+    int res = ::recvmmsg(data->udp_socket, msgs, count, 0, nullptr);
+    for (int i = 0; i < res; ++i) {
+        datagrams[i].size = (int)msgs[i].msg_len;
+    }
+    return res;
+}
+
+// one receive may carry many datagrams of a flow, UDP_GRO tells where they part
+static int recv_coalesced(udp_data* data) {
+    iovec iov = {data->gro_buffer.data(), data->gro_buffer.size()};
+    char control[CMSG_SPACE(sizeof(int))];
+    msghdr msg = {0};
+    msg.msg_iov = &iov;
+    msg.msg_iovlen = 1;
+    msg.msg_control = control;
+    msg.msg_controllen = sizeof(control);
+
+    int res = (int)::recvmsg(data->udp_socket, &msg, 0);
+    if (res < 0) {
+        return res;
+    }
+
+    data->gro_size = data->gro_segment = res;
+    data->gro_offset = 0;
+    for (cmsghdr* cmsg = CMSG_FIRSTHDR(&msg); cmsg; cmsg = CMSG_NXTHDR(&msg, cmsg)) {
+        int segment = 0;
+        if (IPPROTO_UDP == cmsg->cmsg_level && UDP_GRO == cmsg->cmsg_type) {
+            memcpy(&segment, CMSG_DATA(cmsg), sizeof(segment));
+        }
+
+        if (0 < segment) {
+            data->gro_segment = segment;
+        }
+    }
+    return res;
+}
+#else
+static int send_many(udp_data* data, const endpoint::const_buffer* datagrams, int count) {
+    int sent = 0;
+    for (; sent < count; ++sent) {
+        if (::send(data->udp_socket, datagrams[sent].data, buffer_size(datagrams[sent]), SEND_FLAGS) < 0) {
+            break;
+        }
+    }
+    return sent ? sent : -1;
+}
+
+static int recv_many(udp_data* data, endpoint::mutable_buffer* datagrams, int count) {
+    int received = 0;
+    for (; received < count; ++received) {
+        int res = recv_datagram(data->udp_socket, &datagrams[received], 1);
+        if (res < 0) {
+            break;
+        }
+        datagrams[received].size = res;
+    }
+    return received ? received : -1;
+}
+
+static int recv_coalesced(udp_data* data) {
+    return -1;
+}
+#endif
+
+udp::udp(const std::string& info) : endpoint(info), m_data(new udp_data) {
+    socket_data::init();
+    m_data->loop = event_loop::pick();
+}
+
+udp::~udp() {
+    close();
+    delete m_data;
+}
+
+bool udp::listen(connected_notify notify) {
+    socket_address local_addr;
+    if (is_listening() || !fill_address(local_addr, AF_INET, m_info)) {
+        return false;
+    }
+
+    close();
+    m_data->on_connected = notify;
+    if (!open_socket(local_addr, nullptr)) {
+        return false;
+    }
+
+    m_info = get_info(local_addr);
+    return true;
+}
+
+bool udp::connect(const std::string& remote_info, connected_notify notify) {
+    socket_address local_addr;
+    socket_address remote_addr;
+    if (!fill_address(remote_addr, AF_INET, remote_info)) {
+        return false;
+    }
+
+    close();
+    if (!open_socket(local_addr, &remote_addr)) {
+        return false;
+    }
+
+    m_info = get_info(local_addr);
+    m_remote_info = get_info(remote_addr);
+
+    if (notify) {
+        notify();
+    }
+
+    return true;
+}
+
+bool udp::is_listening() const {
+    std::lock_guard<std::mutex> lock(m_data->mutex);
+    return m_data->listening;
+}
+
+bool udp::is_connected() const {
+    std::lock_guard<std::mutex> lock(m_data->mutex);
+    return m_data->connected;
+}
+
+void udp::disconnect() {
+    socket_t udp_socket = INVALID_SOCKET;
+    {
+        std::lock_guard<std::mutex> lock(m_data->mutex);
+        if (!m_data->connected) {
+            return;
+        }
+
+        m_data->connected = false;
+        ++m_data->session;
+        m_data->readable = m_data->writable = false;
+        m_data->gro_size = m_data->gro_offset = 0;
+        m_data->cond.notify_all();
+
+        if (m_data->listening) {
+            dissolve(m_data->udp_socket);
+            update_events(m_data);
+        } else {
+            std::swap(udp_socket, m_data->udp_socket);
+            m_data->events = event_loop::IO_NONE;
+        }
+    }
+
+    if (INVALID_SOCKET != udp_socket) {
+        m_data->loop->detach(udp_socket);
+        closesocket(udp_socket);
+    }
+}
+
+void udp::close() {
+    disconnect();
+
+    socket_t udp_socket = INVALID_SOCKET;
+    {
+        std::lock_guard<std::mutex> lock(m_data->mutex);
+        m_data->listening = false;
+        std::swap(udp_socket, m_data->udp_socket);
+        m_data->events = event_loop::IO_NONE;
+    }
+
+    if (INVALID_SOCKET != udp_socket) {
+        m_data->loop->detach(udp_socket);
+        closesocket(udp_socket);
+    }
+}
+
+int udp::send(const char* buffer, int size) {
+    const_buffer buffers[] = {{buffer, buffer ? size : 0}};
+    return sendv(buffers, 1);
+}
+
+int udp::recv(char* buffer, int size) {
+    mutable_buffer buffers[] = {{buffer, buffer ? size : 0}};
+    return recvv(buffers, 1);
+}
+
+int udp::sendv(const const_buffer* buffers, int count) {
+    int size = total_size(buffers, count);
+    if (size <= 0) {
+        return 0;
+    }
+
+    if (MAX_DATAGRAM_SIZE < size) {
+        return -1;
+    }
+
+    // more pieces than one sendmsg takes are joined first, a datagram goes out whole
+    std::string joined;
+    const_buffer whole[] = {{nullptr, size}};
+    if (MAX_IO_BUFFERS < count) {
+        for (int i = 0; i < count; ++i) {
+            joined.append(buffers[i].data, buffer_size(buffers[i]));
+        }
+
+        whole[0].data = joined.data();
+        buffers = whole;
+        count = 1;
+    }
+
+    std::unique_lock<std::mutex> lock(m_data->mutex);
+    while (m_data->connected) {
+        m_data->writable = false;
+        int res = send_datagram(m_data->udp_socket, buffers, count);
+        if (0 <= res) {
+            return res;
+        }
+
+        if (!was_refused() && (!would_block() || !wait_writable(m_data, lock))) {
+            return -1;
+        }
+    }
+
+    return 0;
+}
+
+int udp::recvv(const mutable_buffer* buffers, int count) {
+    if (total_size(buffers, count) <= 0) {
+        return 0;
+    }
+
+    count = std::min(count, MAX_IO_BUFFERS);
+    std::unique_lock<std::mutex> lock(m_data->mutex);
+    while (m_data->connected) {
+        int res = take_segment(m_data, buffers, count);
+        if (0 < res) {
+            return res;
+        }
+
+        m_data->readable = false;
+        if (m_data->gro) {
+            res = recv_coalesced(m_data);
+            if (0 <= res) {
+                continue;
+            }
+        } else {
+            res = recv_datagram(m_data->udp_socket, buffers, count);
+            if (0 <= res) {
+                if (0 < res) {
+                    return res;
+                }
+                continue;
+            }
+        }
+
+        if (!was_refused() && (!would_block() || !wait_readable(m_data, lock))) {
+            return -1;
+        }
+    }
+
+    return 0;
+}
+
+bool udp::set_option(endpoint_option option, int value) {
+    if (is_listening() || is_connected()) {
+        return false;
+    }
+
+    switch (option) {
+    case OPTION_GRO:
+#if defined K_LINUX
+        m_data->gro = 0 != value;
+        return true;
+#else
+        return false;
+#endif
+    default:
+        break;
+    }
+
+    return false;
+}
+
+int udp::send_batch(const const_buffer* datagrams, int count) {
+    if (!datagrams || count <= 0) {
+        return 0;
+    }
+
+    std::unique_lock<std::mutex> lock(m_data->mutex);
+    int sent = 0;
+    while (m_data->connected && sent < count) {
+        m_data->writable = false;
+        int res = send_many(m_data, datagrams + sent, count - sent);
+        if (0 < res) {
+            sent += res;
+            continue;
+        }
+
+        if (0 == res || (!was_refused() && (!would_block() || !wait_writable(m_data, lock)))) {
+            break;
+        }
+    }
+
+    if (!sent && m_data->connected) {
+        return -1;
+    }
+
+    return sent;
+}
+
+int udp::recv_batch(mutable_buffer* datagrams, int count) {
+    if (!datagrams || count <= 0) {
+        return 0;
+    }
+
+    for (int i = 0; i < count; ++i) {
+        if (buffer_size(datagrams[i]) <= 0) {
+            return -1;
+        }
+    }
+
+    std::unique_lock<std::mutex> lock(m_data->mutex);
+    while (m_data->connected) {
+        int filled = 0;
+        while (filled < count) {
+            int res = take_segment(m_data, &datagrams[filled], 1);
+            if (res <= 0) {
+                break;
+            }
+            datagrams[filled++].size = res;
+        }
+
+        if (filled) {
+            return filled;
+        }
+
+        m_data->readable = false;
+        int res = m_data->gro ? recv_coalesced(m_data) : recv_many(m_data, datagrams, count);
+        if (0 < res && !m_data->gro) {
+            return res;
+        }
+
+        if (0 <= res) {
+            continue;
+        }
+
+        if (!was_refused() && (!would_block() || !wait_readable(m_data, lock))) {
+            return -1;
+        }
+    }
+
+    return 0;
+}
+
+bool udp::open_socket(socket_address& local_addr, socket_address* remote_addr) {
+    socket_t udp_socket = socket(AF_INET, SOCK_DGRAM, 0);
+    if (INVALID_SOCKET == udp_socket) {
+        return false;
+    }
+
+    bool res = set_nonblocking(udp_socket);
+    if (res && remote_addr) {
+        res = 0 == ::connect(udp_socket, remote_addr->get(), remote_addr->size);
+    } else if (res) {
+        res = 0 == bind(udp_socket, local_addr.get(), local_addr.size);
+    }
+
+    local_addr.size = sizeof(sockaddr_storage);
+    if (!res || 0 != getsockname(udp_socket, local_addr.get(), &local_addr.size)) {
+        closesocket(udp_socket);
+        return false;
+    }
+
+#if defined K_LINUX
+    // quietly plain receives where the kernel has no UDP_GRO
+    if (m_data->gro) {
+        int opt = 1;
+        m_data->gro = 0 == setsockopt(udp_socket, IPPROTO_UDP, UDP_GRO, &opt, sizeof(opt));
+        m_data->gro_buffer.resize(m_data->gro ? GRO_BUFFER_SIZE : 0);
+    }
+#endif
+
+    {
+        std::lock_guard<std::mutex> lock(m_data->mutex);
+        m_data->udp_socket = udp_socket;
+        m_data->listening = !remote_addr;
+        m_data->connected = nullptr != remote_addr;
+        m_data->readable = m_data->writable = false;
+        m_data->gro_size = m_data->gro_offset = 0;
+        m_data->events = m_data->listening ? event_loop::IO_READ : event_loop::IO_NONE;
+    }
+
+    if (!m_data->loop->attach(udp_socket, m_data->events, [this](unsigned events) { io_handler(events); })) {
+        close();
+        return false;
+    }
+
+    return true;
+}
+
+void udp::io_handler(unsigned events) {
+    connected_notify notify;
+    {
+        std::lock_guard<std::mutex> lock(m_data->mutex);
+        if (INVALID_SOCKET == m_data->udp_socket) {
+            return;
+        }
+
+        if (!m_data->connected) {
+            socket_address remote_addr;
+            if (!m_data->listening || !take_peer(m_data->udp_socket, remote_addr)) {
+                return;
+            }
+
+            m_data->connected = true;
+            m_remote_info = get_info(remote_addr);
+            notify = m_data->on_connected;
+        }
+
+        if (events & (event_loop::IO_READ | event_loop::IO_ERROR)) {
+            m_data->readable = true;
+        }
+
+        if (events & (event_loop::IO_WRITE | event_loop::IO_ERROR)) {
+            m_data->writable = true;
+        }
+
+        update_events(m_data);
+        m_data->cond.notify_all();
+    }
+
+    if (notify) {
+        notify();
+    }
+}
@@ -0,0 +1,68 @@
+/*
+  MIT License
+
+  Copyright (c) 2025 Kong Pengsheng
+
+  Permission is hereby granted, free of charge, to any person obtaining a copy
+  of this software and associated documentation files (the "Software"), to deal
+  in the Software without restriction, including without limitation the rights
+  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+  copies of the Software, and to permit persons to whom the Software is
+  furnished to do so, subject to the following conditions:
+
+  The above copyright notice and this permission notice shall be included in all
+  copies or substantial portions of the Software.
+
+  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+  SOFTWARE.
+*/
+
+#ifndef UDP_H
+#define UDP_H
+
+#include "endpoint.h"
+
+// datagrams over AF_INET, a send is one datagram and a recv takes one, cut to the
+// buffer when longer, empty ones are skipped. listen binds info and takes the first
+// sender as its peer until disconnect, connect names the peer at once. nothing is
+// retried or reordered, a lost datagram stays lost.
+class udp : public endpoint {
+public:
+    explicit udp(const std::string& info = std::string());
+    virtual ~udp();
+
+public:
+    virtual bool listen(connected_notify notify) override;
+    virtual bool connect(const std::string& remote_info, connected_notify notify) override;
+    virtual bool is_listening() const override;
+    virtual bool is_connected() const override;
+    virtual void disconnect() override;
+    virtual void close() override;
+    virtual int send(const char* buffer, int size) override;
+    virtual int recv(char* buffer, int size) override;
+    virtual int sendv(const const_buffer* buffers, int count) override;
+    virtual int recvv(const mutable_buffer* buffers, int count) override;
+    virtual bool set_option(endpoint_option option, int value) override;
+
+public:
+    // many datagrams per syscall with sendmmsg and recvmmsg where they exist. send_batch
+    // returns how many of the datagrams went out, runs of one size leave as a single
+    // GSO send when the kernel takes it. recv_batch waits for the first datagram, takes
+    // what else is there, sets the size of each buffer filled and returns how many.
+    int send_batch(const const_buffer* datagrams, int count);
+    int recv_batch(mutable_buffer* datagrams, int count);
+
+private:
+    bool open_socket(struct socket_address& local_addr, struct socket_address* remote_addr);
+    void io_handler(unsigned events);
+
+private:
+    struct udp_data* m_data;
+};
+
+#endif
@@ -0,0 +1,48 @@
+/*
+  MIT License
+
+  Copyright (c) 2025 Kong Pengsheng
+
+  Permission is hereby granted, free of charge, to any person obtaining a copy
+  of this software and associated documentation files (the "Software"), to deal
+  in the Software without restriction, including without limitation the rights
+  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+  copies of the Software, and to permit persons to whom the Software is
+  furnished to do so, subject to the following conditions:
+
+  The above copyright notice and this permission notice shall be included in all
+  copies or substantial portions of the Software.
+
+  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+  SOFTWARE.
+*/
+
+#ifndef UNIX_DOMAIN_H
+#define UNIX_DOMAIN_H
+
+#include "tcp.h"
+
+// same host ipc over AF_UNIX, addressed by a filesystem path or by @name in the
+// abstract namespace. listen, connect, serve and the rest behave like tcp.
+class unix_domain : public tcp {
+public:
+    explicit unix_domain(const std::string& info = std::string());
+
+public:
+    // hands open file descriptors to the peer along with the bytes, the peer gets
+    // copies of its own. a stream passes them with the first byte.
+    int send_fds(const char* buffer, int size, const int* fds, int count);
+    // count gives the room in fds and returns how many arrived, the caller closes them.
+    // only for endpoints pulled by recv, pushed input drops the fds.
+    int recv_fds(char* buffer, int size, int* fds, int* count);
+
+protected:
+    virtual tcp* new_session() const override;
+};
+
+#endif
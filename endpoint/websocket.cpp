@@ -23,31 +23,290 @@
 */
 
 #include "websocket.h"
-#include <future>
+#include <cstring>
 #include <random>
 #include <algorithm>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <vector>
 #include "base64/base64.h"
 #include "tcp.h"
-#include "byte_queue.h"
-
-using namespace std::placeholders;
+#include "unix_domain.h"
+#include "inproc.h"
+#include "byte_ring.h"
+#include "endpoint_util.h"
+#include "event_loop.h"
 
 const int RAW_KEY_SIZE = 16;
-const int INPUT_BUFFER_SIZE = 1024 * 6;
+const std::string UNIX_SCHEME = "unix:";
+const std::string INPROC_SCHEME = "inproc:";
+// a message joined from pieces may grow to this size, its buffer is kept up to the other
+const int MAX_MESSAGE_SIZE = 1024 * 1024 * 1024;
+const size_t KEPT_MESSAGE_SIZE = 1024 * 64;
+
+// an async_connect waiting for the handshake. the transport notify holds it and may
+// come after the websocket is gone, it finds the notify taken then and leaves
+struct handshake_wait {
+    std::mutex mutex;
+    endpoint::completion_notify notify;
+};
 
 struct websocket_data {
     tcp* atcp = nullptr;
+    std::string scheme;
+    bool server = false;
     bool handshaked = false;
+    bool closing = false;
     endpoint::connected_notify on_connected;
+    endpoint::session_notify on_session;
+    std::shared_ptr<handshake_wait> waiting;
     std::string key;
-    byte_queue message_queue;
-    byte_queue payload_queue;
-    std::future<void> input_future;
-    std::future<void> disconnect_future;
+    // the upgrade request or reply, a few hundred bytes gathered until it is whole
+    std::string handshake;
+    // frames go through as they come, however large
+    ws_frame_decoder decoder;
+    // filled by the loop, drained by the one thread in recv or by async_recv on the loop
+    byte_ring payload_queue;
+    // OPTION_WAIT and OPTION_MESSAGES, sessions take the ones of their listener
+    int wait = 0;
+    bool messages = false;
+    websocket::message_notify on_message;
+    // a message coming in pieces is joined here, its opcode is the one of its first frame
+    std::vector<char> message;
+    ws_opcode message_opcode = WS_OPCODE_BINARY;
+    // keys of the frames a client masks
+    ws_key_generator keys;
+    std::mutex mutex;
+    std::deque<recv_request> recv_requests;
+    // async_recvs filled straight from a read, finished by the loop once it is through
+    std::vector<std::function<void()>> handed;
+};
+
+// handshakes go straight to the transport
+struct transport_output {
+    tcp* atcp;
+
+    void operator()(const char* message, int size) const {
+        atcp->send(message, size);
+    }
+};
+
+// a client masks every frame with a key of its own
+static const unsigned char* mask_key(websocket_data* data, unsigned char* key) {
+    if (data->server) {
+        return nullptr;
+    }
+
+    data->keys.next(key);
+    return key;
+}
+
+// a loop thread must not wait on the transport and a partial send would cut the frame,
+// so there the frame is queued whole
+static int send_frame(websocket_data* data, ws_opcode opcode, const char* payload, int size) {
+    unsigned char key[4];
+    int res = 0;
+    pack_frame(opcode, mask_key(data, key), payload, size, [data, &res](const endpoint::const_buffer* buffers, int count) {
+        if (event_loop::current() && data->atcp->async_sendv(buffers, count, nullptr)) {
+            res = total_size(buffers, count);
+        } else {
+            res = data->atcp->sendv(buffers, count);
+        }
+    });
+
+    return res;
+}
+
+static bool data_opcode(ws_opcode opcode) {
+    return WS_OPCODE_TEXT == opcode || WS_OPCODE_BINARY == opcode;
+}
+
+// a queued message is its head then its bytes, put in one go so a take never sees half
+struct message_head {
+    int size;
+    ws_opcode opcode;
 };
 
+// the whole size of the next message, what fits in size is copied, -1 for none
+static int take_message(byte_ring& queue, char* buffer, int size, ws_opcode& opcode, bool wait) {
+    message_head head;
+    if (queue.take((char*)&head, sizeof(head), wait) <= 0) {
+        return -1;
+    }
+
+    int copied = 0;
+    if (0 < head.size && 0 < size) {
+        copied = queue.take(buffer, std::min(size, head.size), false);
+    }
+
+    for (int rest = head.size - copied; 0 < rest;) {
+        int res = queue.take([rest](char*, int available) { return std::min(rest, available); }, false);
+        if (res <= 0) {
+            break;
+        }
+
+        rest -= res;
+    }
+
+    opcode = head.opcode;
+    return head.size;
+}
+
+static void finish_recvs(websocket_data* data, std::vector<std::function<void()>>& done) {
+    std::lock_guard<std::mutex> lock(data->mutex);
+    while (!data->recv_requests.empty() && data->payload_queue.size()) {
+        recv_request& request = data->recv_requests.front();
+        int res = 0;
+        if (data->messages) {
+            ws_opcode opcode;
+            int whole = take_message(data->payload_queue, request.buffer, request.size, opcode, false);
+            if (whole < 0) {
+                break;
+            } else if (!whole) {
+                continue;
+            }
+
+            res = std::min(whole, request.size);
+        } else {
+            res = data->payload_queue.take(request.buffer, request.size, false);
+        }
+
+        done.push_back(std::bind(request.notify, res));
+        data->recv_requests.pop_front();
+    }
+}
+
+// payload goes straight into the async_recvs waiting for it, unless bytes are queued
+// ahead of it, the rest is queued. either way it is copied once. false when a reader
+// fell so far behind that the queue cannot take it
+static bool put_payload(websocket_data* data, const char* payload, int size) {
+    {
+        std::lock_guard<std::mutex> lock(data->mutex);
+        while (0 < size && !data->recv_requests.empty() && !data->payload_queue.size()) {
+            recv_request& request = data->recv_requests.front();
+            int res = std::min(size, request.size);
+            memcpy(request.buffer, payload, res);
+            data->handed.push_back(std::bind(request.notify, res));
+            data->recv_requests.pop_front();
+            payload += res;
+            size -= res;
+        }
+    }
+
+    return size <= 0 || 0 <= data->payload_queue.put(payload, size);
+}
+
+// a whole message goes to the notify, or straight into a waiting async_recv when nothing
+// is queued ahead of it, or else into the queue for recv. false as for put_payload
+static bool put_message(websocket_data* data, ws_opcode opcode, const char* message, int size) {
+    if (data->on_message) {
+        data->on_message(opcode, message, size);
+        return true;
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(data->mutex);
+        if (0 < size && !data->recv_requests.empty() && !data->payload_queue.size()) {
+            recv_request& request = data->recv_requests.front();
+            int res = std::min(size, request.size);
+            memcpy(request.buffer, message, res);
+            data->handed.push_back(std::bind(request.notify, res));
+            data->recv_requests.pop_front();
+            return true;
+        }
+    }
+
+    message_head head = { size, opcode };
+    return 0 <= data->payload_queue.put([&head, message, size](char* dest, int dest_size) {
+        memcpy(dest, &head, sizeof(head));
+        if (0 < size) {
+            memcpy(dest + sizeof(head), message, size);
+        }
+
+        return dest_size;
+    }, (int)sizeof(head) + size);
+}
+
+// a message whole in one piece goes on from where it lies, one in pieces is joined first.
+// false for a message too large to join or to queue
+static bool put_message_piece(websocket_data* data, const ws_frame_header& header, const char* payload, int size, bool last) {
+    if (WS_OPCODE_CONTINUE != header.opcode) {
+        data->message_opcode = header.opcode;
+    }
+
+    bool whole = last && header.fin;
+    if (whole && data->message.empty()) {
+        return put_message(data, data->message_opcode, payload, size);
+    }
+
+    if (MAX_MESSAGE_SIZE - (int)data->message.size() < size) {
+        return false;
+    }
+
+    data->message.insert(data->message.end(), payload, payload + size);
+    if (whole) {
+        bool res = put_message(data, data->message_opcode, data->message.data(), (int)data->message.size());
+        data->message.clear();
+        if (KEPT_MESSAGE_SIZE < data->message.capacity()) {
+            std::vector<char>().swap(data->message);
+        }
+
+        return res;
+    }
+
+    return true;
+}
+
+// websockets between local peers run over unix domain sockets addressed as unix:path,
+// or in memory as inproc:name, plain addresses are tcp
+static std::string scheme_of(const std::string& info) {
+    for (const std::string& scheme : {UNIX_SCHEME, INPROC_SCHEME}) {
+        if (0 == info.compare(0, scheme.size(), scheme)) {
+            return scheme;
+        }
+    }
+
+    return std::string();
+}
+
+// the waiting async_connect, if any, taken so that only one result reaches it
+static endpoint::completion_notify take_waiting(websocket_data* data) {
+    std::shared_ptr<handshake_wait> wait;
+    {
+        std::lock_guard<std::mutex> lock(data->mutex);
+        wait.swap(data->waiting);
+    }
+
+    endpoint::completion_notify notify;
+    if (wait) {
+        std::lock_guard<std::mutex> lock(wait->mutex);
+        notify.swap(wait->notify);
+    }
+
+    return notify;
+}
+
+static tcp* create_transport(const std::string& scheme, const std::string& address) {
+    if (UNIX_SCHEME == scheme) {
+        return new unix_domain(address);
+    } else if (INPROC_SCHEME == scheme) {
+        return new inproc(address);
+    }
+
+    return new tcp(address);
+}
+
 websocket::websocket(const std::string& info) : endpoint(info), m_data(new websocket_data) {
-    m_data->atcp = new tcp(info);
+    m_data->scheme = scheme_of(info);
+    m_data->atcp = create_transport(m_data->scheme, info.substr(m_data->scheme.size()));
+}
+
+websocket::websocket(const std::string& info, tcp* atcp) : endpoint(info), m_data(new websocket_data) {
+    m_data->scheme = scheme_of(info);
+    m_data->atcp = atcp;
+    m_data->server = true;
+    update_info();
 }
 
 websocket::~websocket() {
@@ -57,34 +316,76 @@ websocket::~websocket() {
 }
 
 bool websocket::listen(connected_notify notify) {
+    m_data->server = true;
     m_data->on_connected = notify;
 
     bool res = m_data->atcp->listen([this] {
-        m_remote_info = m_data->atcp->remote_info();
-        m_data->input_future = std::async(std::launch::async, &websocket::input_handler, this);
+        update_info();
+        start_input();
     });
 
-    m_info = m_data->atcp->info();
+    update_info();
     return res;
 }
 
 bool websocket::connect(const std::string& remote_info, connected_notify notify) {
+    m_data->server = false;
     m_data->on_connected = notify;
 
-    bool res = m_data->atcp->connect(remote_info, [this, remote_info] {
-        m_data->input_future = std::async(std::launch::async, &websocket::input_handler, this);
+    std::string host = scheme_of(remote_info).empty() ? remote_info : "localhost";
+    std::string address = client_transport(remote_info);
+    bool res = m_data->atcp->connect(address, [this, host] {
+        send_handshake(host);
+    });
+
+    update_info();
+    return res;
+}
+
+bool websocket::async_connect(const std::string& remote_info, completion_notify notify) {
+    if (!notify) {
+        return false;
+    }
 
-        std::random_device rd;
-        std::mt19937 gen(rd());
-        std::uniform_int_distribution<> dis(0, 0xFF);
-        char raw_key[RAW_KEY_SIZE];
-        std::generate(raw_key, raw_key + RAW_KEY_SIZE, [&dis, &gen] { return dis(gen); });
-        m_data->key = base64_encode(raw_key, RAW_KEY_SIZE);
-        pack_handshake(remote_info, m_data->key, std::bind(&tcp::send, m_data->atcp, _1, _2));
+    disconnect();
+    m_data->server = false;
+    m_data->on_connected = nullptr;
+
+    std::shared_ptr<handshake_wait> wait = std::make_shared<handshake_wait>();
+    wait->notify = notify;
+    {
+        std::lock_guard<std::mutex> lock(m_data->mutex);
+        m_data->waiting = wait;
+    }
+
+    // the wait stays locked while the handshake goes out, so disconnect, and with it
+    // the destructor, waits for that to finish
+    std::string host = scheme_of(remote_info).empty() ? remote_info : "localhost";
+    std::string address = client_transport(remote_info);
+    bool res = m_data->atcp->async_connect(address, [this, wait, host](int res) {
+        completion_notify failed;
+        {
+            std::lock_guard<std::mutex> lock(wait->mutex);
+            if (!wait->notify) {
+                return;
+            }
+
+            if (0 < res) {
+                send_handshake(host);
+                return;
+            }
+
+            failed.swap(wait->notify);
+        }
+
+        failed(0);
     });
 
-    m_info = m_data->atcp->info();
-    m_remote_info = m_data->atcp->remote_info();
+    update_info();
+    if (!res) {
+        take_waiting(m_data);
+    }
+
     return res;
 }
 
@@ -97,16 +398,33 @@ bool websocket::is_connected() const {
 }
 
 void websocket::disconnect() {
-    m_data->disconnect_future = std::async(std::launch::async, [this] {
-        if (is_connected()) {
-            pack_frame(WS_OPCODE_CLOSE, !is_listening(), nullptr, 0, std::bind(&tcp::send, m_data->atcp, _1, _2));
-        }
+    completion_notify waiting = take_waiting(m_data);
+    if (waiting) {
+        m_data->atcp->post(std::bind(waiting, 0));
+    }
 
-        m_data->atcp->disconnect();
-        m_data->handshaked = false;
-        m_data->message_queue.exit();
-        m_data->payload_queue.exit();
-    });
+    if (is_connected()) {
+        send_frame(m_data, WS_OPCODE_CLOSE, nullptr, 0);
+    }
+
+    m_data->atcp->disconnect();
+    m_data->handshaked = false;
+
+    std::deque<recv_request> recv_requests;
+    {
+        std::lock_guard<std::mutex> lock(m_data->mutex);
+        m_data->recv_requests.swap(recv_requests);
+    }
+
+    if (!recv_requests.empty()) {
+        m_data->atcp->post([recv_requests] {
+            for (const recv_request& request : recv_requests) {
+                request.notify(0);
+            }
+        });
+    }
+
+    m_data->payload_queue.exit();
 }
 
 void websocket::close() {
@@ -115,78 +433,280 @@ void websocket::close() {
 }
 
 int websocket::send(const char* buffer, int size) {
+    return send_message(WS_OPCODE_BINARY, buffer, size);
+}
+
+int websocket::recv(char* buffer, int size) {
     if (!is_connected()) {
         return 0;
     }
 
-    if (pack_frame(WS_OPCODE_BINARY, !is_listening(), buffer, size, std::bind(&tcp::send, m_data->atcp, _1, _2)) <= 0) {
+    if (m_data->messages) {
+        ws_opcode opcode;
+        int res = 0;
+        while (!res) {
+            res = take_message(m_data->payload_queue, buffer, size, opcode, true);
+        }
+
+        return res < 0 ? 0 : std::min(res, size);
+    }
+
+    return m_data->payload_queue.take(buffer, size);
+}
+
+bool websocket::async_send(const char* buffer, int size, completion_notify notify) {
+    return async_send_message(WS_OPCODE_BINARY, buffer, size, notify);
+}
+
+bool websocket::async_recv(char* buffer, int size, completion_notify notify) {
+    if (!buffer || size <= 0 || !notify || !is_connected()) {
+        return false;
+    }
+
+    std::vector<std::function<void()>> done;
+    {
+        std::lock_guard<std::mutex> lock(m_data->mutex);
+        m_data->recv_requests.push_back({ buffer, size, notify });
+    }
+
+    finish_recvs(m_data, done);
+    for (std::function<void()>& t : done) {
+        m_data->atcp->post(t);
+    }
+
+    return true;
+}
+
+bool websocket::serve(session_notify notify) {
+    if (!notify) {
+        return false;
+    }
+
+    m_data->server = true;
+    m_data->on_connected = nullptr;
+
+    bool res = m_data->atcp->serve([this, notify](endpoint* session) {
+        websocket* ws = new websocket(m_info, static_cast<tcp*>(session));
+        ws->m_data->on_session = notify;
+        ws->m_data->wait = m_data->wait;
+        ws->m_data->messages = m_data->messages;
+        ws->start_input();
+    });
+
+    update_info();
+    return res;
+}
+
+bool websocket::set_option(endpoint_option option, int value) {
+    if (OPTION_WAIT == option) {
+        if (value < -1 || is_listening() || is_connected()) {
+            return false;
+        }
+
+        m_data->wait = value;
+        return true;
+    }
+
+    if (OPTION_MESSAGES == option) {
+        if (is_listening() || is_connected()) {
+            return false;
+        }
+
+        m_data->messages = 0 != value;
+        return true;
+    }
+
+    return m_data->atcp->set_option(option, value);
+}
+
+int websocket::send_message(ws_opcode opcode, const char* buffer, int size) {
+    if (!data_opcode(opcode) || !is_connected()) {
+        return 0;
+    }
+
+    if (send_frame(m_data, opcode, buffer, size) <= 0) {
         return 0;
     }
 
     return size;
 }
 
-int websocket::recv(char* buffer, int size) {
-    if (!is_connected()) {
-        return 0;
+bool websocket::async_send_message(ws_opcode opcode, const char* buffer, int size, completion_notify notify) {
+    if (!data_opcode(opcode) || !is_connected()) {
+        return false;
     }
 
-    return m_data->payload_queue.take(buffer, size);
+    completion_notify sent = nullptr;
+    if (notify) {
+        sent = [notify, size](int res) { notify(0 < res ? size : res); };
+    }
+
+    unsigned char key[4];
+    bool res = false;
+    pack_frame(opcode, mask_key(m_data, key), buffer, size, [this, &res, &sent](const const_buffer* buffers, int count) {
+        res = m_data->atcp->async_sendv(buffers, count, sent);
+    });
+
+    return res;
 }
 
-void websocket::input_handler() {
-    m_data->message_queue.reset();
+int websocket::recv_message(char* buffer, int size, ws_opcode& opcode) {
+    if (!m_data->messages || !is_connected()) {
+        return -1;
+    }
+
+    return take_message(m_data->payload_queue, buffer, size, opcode, true);
+}
+
+void websocket::set_message_notify(message_notify notify) {
+    m_data->on_message = notify;
+}
+
+void websocket::update_info() {
+    const std::string& scheme = m_data->scheme;
+    m_info = scheme + m_data->atcp->info();
+    m_remote_info = m_data->atcp->remote_info().empty() ? std::string() : scheme + m_data->atcp->remote_info();
+}
+
+// a client connects over the transport of the scheme of remote_info, at what follows it
+std::string websocket::client_transport(const std::string& remote_info) {
+    std::string scheme = scheme_of(remote_info);
+    if (scheme != m_data->scheme && !m_data->atcp->is_listening()) {
+        m_data->atcp->close();
+        delete m_data->atcp;
+        m_data->scheme = scheme;
+        m_data->atcp = create_transport(scheme, std::string());
+    }
+
+    return remote_info.substr(scheme.size());
+}
+
+void websocket::send_handshake(const std::string& host) {
+    update_info();
+    start_input();
+
+    std::random_device rd;
+    std::mt19937 gen(rd());
+    std::uniform_int_distribution<> dis(0, 0xFF);
+    char raw_key[RAW_KEY_SIZE];
+    std::generate(raw_key, raw_key + RAW_KEY_SIZE, [&dis, &gen] { return dis(gen); });
+    m_data->key = base64_encode(raw_key, RAW_KEY_SIZE);
+    pack_handshake(host, m_data->key, transport_output{m_data->atcp});
+}
+
+void websocket::start_input() {
+    m_data->handshaked = false;
+    m_data->closing = false;
+    m_data->handshake.clear();
+    m_data->decoder.reset();
+    m_data->message.clear();
     m_data->payload_queue.reset();
+    int wait = m_data->wait;
+    m_data->payload_queue.set_wait(0 < wait ? WAIT_SPIN : (wait < 0 ? WAIT_POLL : WAIT_BLOCK), wait);
+    // small enough for std::function to keep in place, the transport copies it per read
+    m_data->atcp->set_input([this](char* buffer, int size) { input_handler(buffer, size); });
+}
 
-    char* buffer = new char[INPUT_BUFFER_SIZE];
-    int size = 0;
-    while (true) {
-        size = m_data->atcp->recv(buffer, INPUT_BUFFER_SIZE);
-        if (size <= 0) {
-            disconnect();
-            break;
+void websocket::input_handler(char* buffer, int size) {
+    if (0 < size) {
+        if (m_data->handshaked) {
+            frames_handler(buffer, size);
+        } else {
+            handshake_handler(buffer, size);
+        }
+
+        std::vector<std::function<void()>> done;
+        done.swap(m_data->handed);
+        finish_recvs(m_data, done);
+        for (std::function<void()>& t : done) {
+            t();
         }
-        m_data->message_queue.put(buffer, size);
-        m_data->message_queue.take(std::bind(&websocket::message_handler, this, _1, _2), false);
     }
-    delete[] buffer;
+
+    if (size <= 0 || m_data->closing) {
+        disconnect();
+
+        // a session that never completed its handshake is still ours
+        if (m_data->on_session) {
+            event_loop::current()->post([this] { endpoint::destroy(this); });
+        }
+    }
+}
+
+void websocket::connected() {
+    m_data->handshaked = true;
+    if (m_data->on_session) {
+        session_notify notify = nullptr;
+        std::swap(notify, m_data->on_session);
+        notify(this);
+    } else if (m_data->on_connected) {
+        m_data->on_connected();
+    } else if (completion_notify waiting = take_waiting(m_data)) {
+        waiting(1);
+    }
 }
 
-int websocket::message_handler(const char* message, int size) {
-    if (m_data->handshaked) {
-        return unpack_frame(message, size, [this](ws_opcode opcode, const char* payload, int payload_size) {
-            if (WS_OPCODE_CLOSE == opcode) {
-                disconnect();
-            } else if (WS_OPCODE_PING == opcode) {
-                pack_frame(WS_OPCODE_PONG, !is_listening(), nullptr, 0, std::bind(&tcp::send, m_data->atcp, _1, _2));
+// the handshake is gathered whole, what follows it in the same read is frames already
+void websocket::handshake_handler(char* buffer, int size) {
+    m_data->handshake.append(buffer, size);
+    const char* message = m_data->handshake.data();
+    int message_size = (int)m_data->handshake.size();
+    int res = 0;
+    if (m_data->server) {
+        res = unpack_handshake(message, message_size, [this](bool accept, const std::string& key) {
+            if (accept) {
+                pack_rhandshake(key, transport_output{m_data->atcp});
+                connected();
             } else {
-                m_data->payload_queue.put(payload, payload_size);
+                m_data->closing = true;
             }
         });
-    }
-
-    if (m_data->atcp->is_listening()) {
-        return unpack_handshake(message, size, [this](bool accept, const std::string& key) {
+    } else {
+        res = unpack_rhandshake(message, message_size, m_data->key, [this](bool accept) {
             if (accept) {
-                pack_rhandshake(key, std::bind(&tcp::send, m_data->atcp, _1, _2));
-                m_data->handshaked = true;
-                if (m_data->on_connected) {
-                    m_data->on_connected();
-                }
+                connected();
             } else {
-                disconnect();
+                m_data->closing = true;
             }
         });
     }
 
-    return unpack_rhandshake(message, size, m_data->key, [this](bool accept) {
-        if (accept) {
-            m_data->handshaked = true;
-            if (m_data->on_connected) {
-                m_data->on_connected();
+    if (res <= 0) {
+        return;
+    }
+
+    std::string frames = m_data->handshake.substr(res);
+    std::string().swap(m_data->handshake);
+    if (m_data->handshaked && !frames.empty()) {
+        frames_handler(&frames[0], (int)frames.size());
+    }
+}
+
+void websocket::frames_handler(char* buffer, int size) {
+    int res = m_data->decoder.feed(buffer, size, [this](const ws_frame_header& header, const char* payload, int payload_size, bool last) {
+        // nothing after a close frame or a payload that could not be queued
+        if (m_data->closing) {
+            return;
+        }
+
+        if (WS_OPCODE_CLOSE == header.opcode) {
+            m_data->closing = true;
+        } else if (WS_OPCODE_PING == header.opcode) {
+            if (last) {
+                send_frame(m_data, WS_OPCODE_PONG, nullptr, 0);
+            }
+        } else if (WS_OPCODE_PONG != header.opcode) {
+            // rather than lose bytes from the middle of the stream the session closes
+            bool put = !m_data->messages && !m_data->on_message ?
+                put_payload(m_data, payload, payload_size) :
+                put_message_piece(m_data, header, payload, payload_size, last);
+            if (!put) {
+                m_data->closing = true;
             }
-        } else {
-            disconnect();
         }
     });
+
+    if (res < 0) {
+        m_data->closing = true;
+    }
 }
@@ -29,6 +29,11 @@
 #include "ws_message.h"
 
 class websocket : public endpoint {
+public:
+    // a whole message and its opcode, WS_OPCODE_TEXT or WS_OPCODE_BINARY, a message sent
+    // in fragments comes joined
+    using message_notify = std::function<void(ws_opcode opcode, const char* message, int size)>;
+
 public:
     explicit websocket(const std::string& info = std::string());
     virtual ~websocket();
@@ -42,10 +47,35 @@ public:
     virtual void close() override;
     virtual int send(const char* buffer, int size) override;
     virtual int recv(char* buffer, int size) override;
+    virtual bool async_send(const char* buffer, int size, completion_notify notify) override;
+    virtual bool async_recv(char* buffer, int size, completion_notify notify) override;
+    virtual bool async_connect(const std::string& remote_info, completion_notify notify) override;
+    virtual bool serve(session_notify notify) override;
+    virtual bool set_option(endpoint_option option, int value) override;
+
+public:
+    // one message of one frame, text or binary. send_message returns size, 0 on failure
+    int send_message(ws_opcode opcode, const char* buffer, int size);
+    bool async_send_message(ws_opcode opcode, const char* buffer, int size, completion_notify notify);
+    // the next message with OPTION_MESSAGES, cut to size. returns its whole size, so a
+    // larger one was cut, or -1 once disconnected
+    int recv_message(char* buffer, int size, ws_opcode& opcode);
+    // messages go to notify on the loop thread where they sit instead of being queued for
+    // recv. set before listen or connect, a session in its session notify
+    void set_message_notify(message_notify notify);
+
+private:
+    websocket(const std::string& info, class tcp* atcp);
 
 private:
-    void input_handler();
-    int message_handler(const char* message, int size);
+    void update_info();
+    std::string client_transport(const std::string& remote_info);
+    void send_handshake(const std::string& host);
+    void start_input();
+    void input_handler(char* buffer, int size);
+    void connected();
+    void handshake_handler(char* buffer, int size);
+    void frames_handler(char* buffer, int size);
 
 private:
     struct websocket_data* m_data;
@@ -0,0 +1,179 @@
+/*
+  MIT License
+
+  Copyright (c) 2025 Kong Pengsheng
+
+  Permission is hereby granted, free of charge, to any person obtaining a copy
+  of this software and associated documentation files (the "Software"), to deal
+  in the Software without restriction, including without limitation the rights
+  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+  copies of the Software, and to permit persons to whom the Software is
+  furnished to do so, subject to the following conditions:
+
+  The above copyright notice and this permission notice shall be included in all
+  copies or substantial portions of the Software.
+
+  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+  SOFTWARE.
+*/
+
+#include "ws_mask.h"
+#include <cstdint>
+#include <cstring>
+#include <atomic>
+#if (defined __x86_64__ || defined __i386__) && defined __GNUC__
+#include <immintrin.h>
+#define X86_KERNELS
+#define TARGET(isa) __attribute__((target(isa)))
+#elif defined _M_X64
+#include <intrin.h>
+#include <immintrin.h>
+#define X86_KERNELS
+#define TARGET(isa)
+#endif
+
+// key holds the four key bytes in memory order, already turned to the phase of src[0]
+using mask_kernel = void (*)(const unsigned char* src, unsigned char* dest, size_t size, uint32_t key);
+
+static void mask_scalar(const unsigned char* src, unsigned char* dest, size_t size, uint32_t key) {
+    unsigned char bytes[4];
+    memcpy(bytes, &key, 4);
+    for (size_t i = 0; i < size; ++i) {
+        dest[i] = src[i] ^ bytes[i % 4];
+    }
+}
+
+// the key twice over in one word. the wider kernels leave their tails here, they stop
+// at a multiple of four so the key stays in phase
+static void mask_word(const unsigned char* src, unsigned char* dest, size_t size, uint32_t key) {
+    uint64_t wide = (uint64_t)key << 32 | key;
+    size_t i = 0;
+    for (; i + 8 <= size; i += 8) {
+        uint64_t word;
+        memcpy(&word, src + i, 8);
+        word ^= wide;
+        memcpy(dest + i, &word, 8);
+    }
+
+    mask_scalar(src + i, dest + i, size - i, key);
+}
+
+#if defined X86_KERNELS
+TARGET("sse2") static void mask_sse2(const unsigned char* src, unsigned char* dest, size_t size, uint32_t key) {
+    __m128i wide = _mm_set1_epi32((int)key);
+    size_t i = 0;
+    for (; i + 16 <= size; i += 16) {
+        __m128i block = _mm_loadu_si128((const __m128i*)(src + i));
+        _mm_storeu_si128((__m128i*)(dest + i), _mm_xor_si128(block, wide));
+    }
+
+    mask_word(src + i, dest + i, size - i, key);
+}
+
+TARGET("avx2") static void mask_avx2(const unsigned char* src, unsigned char* dest, size_t size, uint32_t key) {
+    __m256i wide = _mm256_set1_epi32((int)key);
+    size_t i = 0;
+    for (; i + 32 <= size; i += 32) {
+        __m256i block = _mm256_loadu_si256((const __m256i*)(src + i));
+        _mm256_storeu_si256((__m256i*)(dest + i), _mm256_xor_si256(block, wide));
+    }
+
+    mask_word(src + i, dest + i, size - i, key);
+}
+
+TARGET("avx512f") static void mask_avx512(const unsigned char* src, unsigned char* dest, size_t size, uint32_t key) {
+    __m512i wide = _mm512_set1_epi32((int)key);
+    size_t i = 0;
+    for (; i + 64 <= size; i += 64) {
+        __m512i block = _mm512_loadu_si512((const void*)(src + i));
+        _mm512_storeu_si512((void*)(dest + i), _mm512_xor_si512(block, wide));
+    }
+
+    mask_avx2(src + i, dest + i, size - i, key);
+}
+
+static const mask_kernel KERNELS[] = {mask_scalar, mask_word, mask_sse2, mask_avx2, mask_avx512};
+#else
+static const mask_kernel KERNELS[] = {mask_scalar, mask_word, mask_word, mask_word, mask_word};
+#endif
+
+// the os has to save the wide registers too, which the cpu flags alone don't tell
+static ws_mask_kernel widest_kernel() {
+#if defined X86_KERNELS && defined __GNUC__
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx512f")) {
+        return WS_MASK_AVX512;
+    } else if (__builtin_cpu_supports("avx2")) {
+        return WS_MASK_AVX2;
+    } else if (__builtin_cpu_supports("sse2")) {
+        return WS_MASK_SSE2;
+    }
+#elif defined X86_KERNELS
+    int info[4];
+    __cpuid(info, 0);
+    int levels = info[0];
+    __cpuid(info, 1);
+    unsigned long long saved = (info[2] & (1 << 27)) ? _xgetbv(0) : 0;
+    if (7 <= levels) {
+        __cpuidex(info, 7, 0);
+        if ((info[1] & (1 << 16)) && 0xE6 == (saved & 0xE6)) {
+            return WS_MASK_AVX512;
+        } else if ((info[1] & (1 << 5)) && 0x6 == (saved & 0x6)) {
+            return WS_MASK_AVX2;
+        }
+    }
+
+    return WS_MASK_SSE2;
+#endif
+    return WS_MASK_WORD;
+}
+
+static std::atomic<int> s_kernel(-1);
+
+static mask_kernel selected_kernel() {
+    int kernel = s_kernel.load(std::memory_order_relaxed);
+    if (kernel < 0) {
+        int widest = widest_kernel();
+        kernel = s_kernel.compare_exchange_strong(kernel, widest) ? widest : kernel;
+    }
+
+    return KERNELS[kernel];
+}
+
+void ws_mask(const char* src, char* dest, size_t size, const unsigned char* key, int phase) {
+    if (!src || !dest || !key || !size) {
+        return;
+    }
+
+    unsigned char turned[4];
+    for (int i = 0; i < 4; ++i) {
+        turned[i] = key[(phase + i) & 3];
+    }
+
+    uint32_t word;
+    memcpy(&word, turned, 4);
+    selected_kernel()((const unsigned char*)src, (unsigned char*)dest, size, word);
+}
+
+void ws_mask(char* data, size_t size, const unsigned char* key, int phase) {
+    ws_mask(data, data, size, key, phase);
+}
+
+ws_mask_kernel ws_mask_selected() {
+    selected_kernel();
+    return (ws_mask_kernel)s_kernel.load(std::memory_order_relaxed);
+}
+
+bool ws_mask_select(ws_mask_kernel kernel) {
+    if (kernel < WS_MASK_SCALAR || widest_kernel() < kernel) {
+        return false;
+    }
+
+    s_kernel.store(kernel, std::memory_order_relaxed);
+    return true;
+}
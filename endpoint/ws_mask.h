@@ -0,0 +1,49 @@
+/*
+  MIT License
+
+  Copyright (c) 2025 Kong Pengsheng
+
+  Permission is hereby granted, free of charge, to any person obtaining a copy
+  of this software and associated documentation files (the "Software"), to deal
+  in the Software without restriction, including without limitation the rights
+  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+  copies of the Software, and to permit persons to whom the Software is
+  furnished to do so, subject to the following conditions:
+
+  The above copyright notice and this permission notice shall be included in all
+  copies or substantial portions of the Software.
+
+  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+  SOFTWARE.
+*/
+
+#ifndef WS_MASK_H
+#define WS_MASK_H
+
+#include <cstddef>
+
+// ways to xor a payload with its mask key, from a byte at a time to 64 bytes at a time
+enum ws_mask_kernel {
+    WS_MASK_SCALAR,
+    WS_MASK_WORD,
+    WS_MASK_SSE2,
+    WS_MASK_AVX2,
+    WS_MASK_AVX512
+};
+
+// masks or unmasks size bytes as RFC 6455 does, byte i xored with key[(phase + i) % 4].
+// phase is where in the key a payload handled in pieces goes on from. src may be dest
+void ws_mask(const char* src, char* dest, size_t size, const unsigned char* key, int phase = 0);
+void ws_mask(char* data, size_t size, const unsigned char* key, int phase = 0);
+
+// the widest kernel the cpu runs is picked on first use. another one can be selected to
+// compare them, false if the cpu can't run it
+ws_mask_kernel ws_mask_selected();
+bool ws_mask_select(ws_mask_kernel kernel);
+
+#endif
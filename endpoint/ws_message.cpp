@@ -23,15 +23,19 @@
 */
 
 #include "ws_message.h"
+#include "ws_mask.h"
 #include <cstring>
+#include <algorithm>
 #include <sstream>
 #include <map>
 #include <random>
+#include <vector>
 #include "base64/base64.h"
 #include "sha1/sha1.h"
 
 const char* const SPACE_SET = "\t\r\n ";
-const int MAX_FRAME_HEADER_SIZE = 14;
+// a thread keeps the buffer of its masked frames up to this size
+const size_t KEPT_FRAME_SIZE = 1024 * 64;
 
 using line_info_t = std::vector<std::string>;
 using header_info_t = std::map<std::string, std::string>;
@@ -162,16 +166,27 @@ int unpack_rhandshake(const char* message, int size, const std::string& key, unp
     return res;
 }
 
-int pack_frame(ws_opcode opcode, bool mask, const char* payload, int size, pack_output output) {
-    if (size < 0 || (0 < size && !payload) || !output) {
-        return 0;
+ws_key_generator::ws_key_generator() {
+    std::random_device rd;
+    m_counter = (uint64_t)rd() << 32 | rd();
+}
+
+void ws_key_generator::next(unsigned char* key) {
+    uint64_t z = m_counter.fetch_add(0x9E3779B97F4A7C15ULL, std::memory_order_relaxed) + 0x9E3779B97F4A7C15ULL;
+    z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ULL;
+    z = (z ^ (z >> 27)) * 0x94D049BB133111EBULL;
+    z ^= z >> 31;
+    for (int i = 0; i < 4; ++i) {
+        key[i] = (unsigned char)(z >> (i * 8));
     }
+}
 
-    unsigned char* message = new unsigned char[MAX_FRAME_HEADER_SIZE + size];
+int pack_frame_header(ws_opcode opcode, const unsigned char* mask_key, int size, char* header) {
+    unsigned char* message = (unsigned char*)header;
 
     int pos = 0;
     message[pos++] = 0x80 | opcode;
-    message[pos] = mask ? 0x80 : 0;
+    message[pos] = mask_key ? 0x80 : 0;
     if (size < 126) {
         message[pos++] |= size;
     } else if (126 <= size && size < 0x10000) {
@@ -190,92 +205,180 @@ int pack_frame(ws_opcode opcode, bool mask, const char* payload, int size, pack_
         message[pos++] = size & 0xFF;
     }
 
-    if (mask) {
-        std::random_device rd;
-        std::mt19937 gen(rd());
-        std::uniform_int_distribution<> dis(0, 0xFF);
-        unsigned char mask_key[4];
-        for (unsigned char& k : mask_key) {
-            message[pos++] = k = dis(gen);
-        }
+    if (mask_key) {
+        memcpy(message + pos, mask_key, 4);
+        pos += 4;
+    }
 
-        for (int i = 0; i < size; ++i) {
-            message[pos++] = ((const unsigned char*)payload)[i] ^ mask_key[i % 4];
-        }
-    } else {
-        memcpy(message + pos, payload, size);
-        pos += size;
+    return pos;
+}
+
+int pack_frame(ws_opcode opcode, const unsigned char* mask_key, const char* payload, int size, pack_frame_output output) {
+    if (size < 0 || (0 < size && !payload) || !output) {
+        return 0;
+    }
+
+    if (!mask_key) {
+        char header[MAX_FRAME_HEADER_SIZE];
+        endpoint::const_buffer buffers[] = {{header, pack_frame_header(opcode, nullptr, size, header)}, {payload, size}};
+        output(buffers, size ? 2 : 1);
+        return buffers[0].size + size;
+    }
+
+    static thread_local std::vector<char> frame;
+    if (frame.size() < (size_t)(MAX_FRAME_HEADER_SIZE + size)) {
+        frame.resize(MAX_FRAME_HEADER_SIZE + size);
     }
 
-    output((char*)message, pos);
+    int pos = pack_frame_header(opcode, mask_key, size, frame.data());
+    ws_mask(payload, frame.data() + pos, size, mask_key);
+    pos += size;
 
-    delete[] message;
+    endpoint::const_buffer buffers[] = {{frame.data(), pos}};
+    output(buffers, 1);
+    if (KEPT_FRAME_SIZE < frame.capacity()) {
+        std::vector<char>().swap(frame);
+    }
 
     return pos;
 }
 
-int unpack_frame(const char* message, int size, unpack_frame_output output) {
-    if (!message || size < 2 || !output) {
+int unpack_frame_header(const char* message, int size, ws_frame_header& header) {
+    if (!message || size < 2) {
         return 0;
     }
 
     const unsigned char* _message = (const unsigned char*)message;
 
     int pos = 0;
-    int fin = _message[pos] & 0x80;
-    ws_opcode opcode = (ws_opcode)(_message[pos++] & 0x0F);
-    int mask = _message[pos] & 0x80;
-    int payload_size = _message[pos++] & 0x7F;
-
-    if (126 == payload_size) {
-        if (size < pos + 2) {
-            return 0;
-        }
-        payload_size = _message[pos++] << 8;
-        payload_size |= _message[pos++];
-    } else if (127 == payload_size) {
-        if (size < pos + 8) {
-            return 0;
-        }
-        payload_size = (int64_t)_message[pos++] << 56;
-        payload_size |= (int64_t)_message[pos++] << 48;
-        payload_size |= (int64_t)_message[pos++] << 40;
-        payload_size |= (int64_t)_message[pos++] << 32;
-        payload_size |= _message[pos++] << 24;
-        payload_size |= _message[pos++] << 16;
-        payload_size |= _message[pos++] << 8;
-        payload_size |= _message[pos++];
-    }
-
-    unsigned char mask_key[4];
-    if (mask) {
-        if (size < pos + 4) {
-            return 0;
+    header.fin = 0 != (_message[pos] & 0x80);
+    header.opcode = (ws_opcode)(_message[pos++] & 0x0F);
+    header.masked = 0 != (_message[pos] & 0x80);
+    header.size = _message[pos++] & 0x7F;
+
+    int length_size = 126 == header.size ? 2 : (127 == header.size ? 8 : 0);
+    if (size < pos + length_size + (header.masked ? 4 : 0)) {
+        return 0;
+    }
+
+    if (length_size) {
+        header.size = 0;
+        for (int i = 0; i < length_size; ++i) {
+            header.size = header.size << 8 | _message[pos++];
         }
-        memcpy(mask_key, _message + pos, 4);
+    }
+
+    if (header.size >> 63) {
+        return -1;
+    }
+
+    if (header.masked) {
+        memcpy(header.mask_key, _message + pos, 4);
         pos += 4;
     }
 
-    if (size < pos + payload_size) {
+    return pos;
+}
+
+int unpack_frame(const char* message, int size, unpack_frame_output output) {
+    if (!message || size < 2 || !output) {
         return 0;
     }
 
+    ws_frame_header header;
+    int pos = unpack_frame_header(message, size, header);
+    if (pos <= 0) {
+        return pos;
+    }
+
+    if ((unsigned long long)(size - pos) < header.size) {
+        return 0;
+    }
+
+    int payload_size = (int)header.size;
     if (!payload_size) {
-        output(opcode, nullptr, 0);
+        output(header.opcode, nullptr, 0);
         return pos;
     }
 
-    if (mask) {
-        unsigned char* payload = new unsigned char[payload_size];
-        for (int i = 0; i < payload_size; ++i) {
-            payload[i] = _message[pos++] ^ mask_key[i % 4];
-        }
-        output(opcode, (char*)payload, payload_size);
+    if (header.masked) {
+        char* payload = new char[payload_size];
+        ws_mask(message + pos, payload, payload_size, header.mask_key);
+        output(header.opcode, payload, payload_size);
         delete[] payload;
     } else {
-        output(opcode, message + pos, payload_size);
-        pos += payload_size;
+        output(header.opcode, message + pos, payload_size);
     }
 
-    return pos;
+    return pos + payload_size;
+}
+
+ws_frame_decoder::ws_frame_decoder() {
+    reset();
+}
+
+int ws_frame_decoder::feed(char* data, int size, frame_piece_output output) {
+    if (m_failed || size < 0 || (0 < size && !data) || !output) {
+        return -1;
+    }
+
+    int pos = 0;
+    while (pos < size) {
+        if (m_in_payload) {
+            int piece = (int)std::min<unsigned long long>(m_remaining, size - pos);
+            put_payload(data + pos, piece, output);
+            pos += piece;
+            continue;
+        }
+
+        int res = gather_header(data + pos, size - pos);
+        if (res < 0) {
+            m_failed = true;
+            return -1;
+        }
+
+        pos += res;
+        if (m_in_payload && !m_remaining) {
+            m_in_payload = false;
+            output(m_header, nullptr, 0, true);
+        }
+    }
+
+    return size;
+}
+
+void ws_frame_decoder::reset() {
+    m_gathered = 0;
+    m_header = ws_frame_header();
+    m_remaining = 0;
+    m_in_payload = false;
+    m_failed = false;
+}
+
+// takes up to a whole header, what it takes past the header's end is given back
+int ws_frame_decoder::gather_header(const char* data, int size) {
+    int before = m_gathered;
+    int count = std::min(size, MAX_FRAME_HEADER_SIZE - m_gathered);
+    memcpy(m_header_bytes + m_gathered, data, count);
+    m_gathered += count;
+
+    int header_size = unpack_frame_header(m_header_bytes, m_gathered, m_header);
+    if (header_size <= 0) {
+        return header_size < 0 ? -1 : count;
+    }
+
+    m_gathered = 0;
+    m_remaining = m_header.size;
+    m_in_payload = true;
+    return header_size - before;
+}
+
+void ws_frame_decoder::put_payload(char* data, int size, frame_piece_output& output) {
+    if (m_header.masked) {
+        ws_mask(data, size, m_header.mask_key, (int)((m_header.size - m_remaining) & 3));
+    }
+
+    m_remaining -= size;
+    m_in_payload = 0 < m_remaining;
+    output(m_header, data, size, !m_remaining);
 }
@@ -25,8 +25,13 @@
 #ifndef WS_MESSAGE_H
 #define WS_MESSAGE_H
 
-#include <functional>
+#include <atomic>
+#include <cstdint>
 #include <string>
+#include "endpoint.h"
+#include "function_ref.h"
+
+const int MAX_FRAME_HEADER_SIZE = 14;
 
 enum ws_opcode {
 
@@ -38,10 +43,36 @@ enum ws_opcode {
     WS_OPCODE_PONG      = 0xA
 };
 
-using pack_output = std::function<void(const char* message, int size)>;
-using unpack_handshake_output = std::function<void(bool accept, const std::string& key)>;
-using unpack_rhandshake_output = std::function<void(bool accept)>;
-using unpack_frame_output = std::function<void(ws_opcode opcode, const char* payload, int size)>;
+struct ws_frame_header {
+    ws_opcode opcode;
+    bool fin;
+    bool masked;
+    unsigned char mask_key[4];
+    unsigned long long size;
+};
+
+// outputs are called before the pack or unpack returns
+using pack_output = function_ref<void(const char* message, int size)>;
+using unpack_handshake_output = function_ref<void(bool accept, const std::string& key)>;
+using unpack_rhandshake_output = function_ref<void(bool accept)>;
+using unpack_frame_output = function_ref<void(ws_opcode opcode, const char* payload, int size)>;
+// a frame as pieces for one vectored write, an unmasked payload is one of them as it is
+using pack_frame_output = function_ref<void(const endpoint::const_buffer* buffers, int count)>;
+// a piece of a frame's payload, last for the one that ends it
+using frame_piece_output = function_ref<void(const ws_frame_header& header, const char* payload, int size, bool last)>;
+
+// mask keys for the frames of one connection, splitmix64 over a counter seeded once from
+// the system source. the keys only have to be unknown to what the payload comes from,
+// RFC 6455 10.3, and several threads may draw at once
+class ws_key_generator {
+public:
+    ws_key_generator();
+
+    void next(unsigned char* key);
+
+private:
+    std::atomic<uint64_t> m_counter;
+};
 
 int pack_handshake(const std::string& host, const std::string& key, pack_output output);
 int unpack_handshake(const char* message, int size, unpack_handshake_output output);
@@ -49,7 +80,42 @@ int unpack_handshake(const char* message, int size, unpack_handshake_output outp
 int pack_rhandshake(const std::string& key, pack_output output);
 int unpack_rhandshake(const char* message, int size, const std::string& key, unpack_rhandshake_output output);
 
-int pack_frame(ws_opcode opcode, bool mask, const char* payload, int size, pack_output output);
+// writes the header of a frame of size bytes, masked with mask_key unless it is null, and
+// returns its size. header has room for MAX_FRAME_HEADER_SIZE bytes
+int pack_frame_header(ws_opcode opcode, const unsigned char* mask_key, int size, char* header);
+// the frame's header goes on the stack, a masked frame is put together in a buffer kept
+// by the calling thread
+int pack_frame(ws_opcode opcode, const unsigned char* mask_key, const char* payload, int size, pack_frame_output output);
+// parses the frame header at the front of message and returns its size, 0 while it is
+// not all there, -1 for a length with the top bit set
+int unpack_frame_header(const char* message, int size, ws_frame_header& header);
+// a whole frame in one piece, -1 for one that couldn't be
 int unpack_frame(const char* message, int size, unpack_frame_output output);
 
+// frames out of bytes in whatever pieces they come, without holding on to a frame. the
+// header is gathered and parsed once, then the payload goes to output as it arrives,
+// unmasked where it lies with the key going on where the last piece left off. an empty
+// payload comes as one empty last piece. lengths go up to 63 bits
+class ws_frame_decoder {
+public:
+    ws_frame_decoder();
+
+    // takes all the bytes, or -1 for a malformed frame after which it takes nothing
+    // until reset. masked payloads are written over in data
+    int feed(char* data, int size, frame_piece_output output);
+    void reset();
+
+private:
+    int gather_header(const char* data, int size);
+    void put_payload(char* data, int size, frame_piece_output& output);
+
+private:
+    char m_header_bytes[MAX_FRAME_HEADER_SIZE];
+    int m_gathered;
+    ws_frame_header m_header;
+    unsigned long long m_remaining;
+    bool m_in_payload;
+    bool m_failed;
+};
+
 #endif
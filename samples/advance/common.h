@@ -37,7 +37,10 @@ const int DATA_BUFFER_SIZE = 4096 * 10;
 const menu_items TYPE_ITEMS = {
     {endpoint::BLUETOOTH,       "BLUETOOTH"},
     {endpoint::TCP,             "TCP"},
-    {endpoint::WEBSOCKET,       "WEBSOCKET"}
+    {endpoint::WEBSOCKET,       "WEBSOCKET"},
+    {endpoint::UNIX,            "UNIX"},
+    {endpoint::SHM,             "SHM"},
+    {endpoint::NETSIM,          "NETSIM"}
 };
 
 const menu_items COMMAND_ITEMS = {
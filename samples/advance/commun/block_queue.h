@@ -25,64 +25,161 @@
 #ifndef BLOCK_QUEUE_H
 #define BLOCK_QUEUE_H
 
+#include <algorithm>
+#include <atomic>
 #include <deque>
+#include <functional>
+#include <vector>
 #include <mutex>
 #include <condition_variable>
+#include "spin_wait.h"
 
+// objects put at the back and taken from the front. with watermarks set a put at high
+// objects waits until takes bring the queue down to low, or fails. exit wakes everyone,
+// puts fail from then on and takes get what is left, then a default object or nothing.
+// clear makes the queue usable again
 template<class type>
 class block_queue {
+public:
+    // what a put does when the queue is full
+    enum full_policy {
+        BLOCK,
+        FAIL
+    };
+
+    using writable_notify = std::function<void()>;
+
 public:
     block_queue() = default;
     block_queue(const block_queue&) = delete;
     block_queue& operator=(const block_queue&) = delete;
 
 public:
+    void set_watermarks(size_t high, size_t low, full_policy policy = BLOCK);
+    // runs on the taking thread, outside the lock, when a full queue is down to low
+    void set_writable_notify(writable_notify notify);
+    // how a take waits on an empty queue, spins looks before it sleeps for WAIT_SPIN
+    void set_wait(wait_mode mode, int spins = 0);
+
     template<class... arguments>
-    void put(arguments&&... args);
-    void put(const type& obj);
-    void put(type&& obj);
+    bool put(arguments&&... args);
+    bool put(const type& obj);
+    bool put(type&& obj);
     type take();
+    std::vector<type> take(size_t max);
 
     size_t size();
     void clear();
+    void exit();
+
+private:
+    bool admit(std::unique_lock<std::mutex>& lock);
+    void taken(std::unique_lock<std::mutex>& lock);
+    void wait_objects(std::unique_lock<std::mutex>& lock);
+    void wake_takers();
 
 private:
     std::deque<type> m_queue;
+    size_t m_high = 0, m_low = 0;
+    full_policy m_policy = BLOCK;
+    bool m_full = false;
+    bool m_exiting = false;
+    writable_notify m_on_writable;
+    wait_mode m_wait_mode = WAIT_BLOCK;
+    int m_spins = 0;
+    // moved by wake_takers, for spin_until_woken
+    std::atomic<unsigned> m_wakes{0};
     std::mutex m_mutex;
     std::condition_variable m_cond_has;
+    std::condition_variable m_cond_room;
 };
 
 template<class type>
-template<class... arguments>
-inline void block_queue<type>::put(arguments&&... args) {
+inline void block_queue<type>::set_watermarks(size_t high, size_t low, full_policy policy) {
     std::lock_guard<std::mutex> lock(m_mutex);
-    m_queue.emplace_back(std::forward<arguments>(args)...);
-    m_cond_has.notify_all();
+    m_high = high;
+    m_low = std::min(low, high);
+    m_policy = policy;
+    m_cond_room.notify_all();
 }
 
 template<class type>
-inline void block_queue<type>::put(const type& obj) {
+inline void block_queue<type>::set_writable_notify(writable_notify notify) {
     std::lock_guard<std::mutex> lock(m_mutex);
-    m_queue.push_back(obj);
-    m_cond_has.notify_all();
+    m_on_writable = notify;
 }
 
 template<class type>
-inline void block_queue<type>::put(type&& obj) {
+inline void block_queue<type>::set_wait(wait_mode mode, int spins) {
     std::lock_guard<std::mutex> lock(m_mutex);
+    m_wait_mode = mode;
+    m_spins = std::max(spins, 0);
+}
+
+template<class type>
+template<class... arguments>
+inline bool block_queue<type>::put(arguments&&... args) {
+    std::unique_lock<std::mutex> lock(m_mutex);
+    if (!admit(lock)) {
+        return false;
+    }
+
+    m_queue.emplace_back(std::forward<arguments>(args)...);
+    wake_takers();
+    return true;
+}
+
+template<class type>
+inline bool block_queue<type>::put(const type& obj) {
+    std::unique_lock<std::mutex> lock(m_mutex);
+    if (!admit(lock)) {
+        return false;
+    }
+
     m_queue.push_back(obj);
-    m_cond_has.notify_all();
+    wake_takers();
+    return true;
+}
+
+template<class type>
+inline bool block_queue<type>::put(type&& obj) {
+    std::unique_lock<std::mutex> lock(m_mutex);
+    if (!admit(lock)) {
+        return false;
+    }
+
+    m_queue.push_back(std::move(obj));
+    wake_takers();
+    return true;
 }
 
 template<class type>
 inline type block_queue<type>::take() {
     std::unique_lock<std::mutex> lock(m_mutex);
-    m_cond_has.wait(lock, [this]() { return !m_queue.empty(); });
+    wait_objects(lock);
+    if (m_queue.empty()) {
+        return type();
+    }
+
     type obj(std::move(m_queue.front()));
     m_queue.pop_front();
+    taken(lock);
     return std::move(obj);
 }
 
+template<class type>
+inline std::vector<type> block_queue<type>::take(size_t max) {
+    std::unique_lock<std::mutex> lock(m_mutex);
+    wait_objects(lock);
+    std::vector<type> objs;
+    while (!m_queue.empty() && objs.size() < max) {
+        objs.push_back(std::move(m_queue.front()));
+        m_queue.pop_front();
+    }
+    taken(lock);
+    return objs;
+}
+
 template<class type>
 inline size_t block_queue<type>::size() {
     std::lock_guard<std::mutex> lock(m_mutex);
@@ -93,6 +190,63 @@ template<class type>
 inline void block_queue<type>::clear() {
     std::lock_guard<std::mutex> lock(m_mutex);
     m_queue.clear();
+    m_full = false;
+    m_exiting = false;
+    m_cond_room.notify_all();
+}
+
+template<class type>
+inline void block_queue<type>::exit() {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_exiting = true;
+    wake_takers();
+    m_cond_room.notify_all();
+}
+
+template<class type>
+inline bool block_queue<type>::admit(std::unique_lock<std::mutex>& lock) {
+    if (!m_exiting && m_high && m_high <= m_queue.size()) {
+        m_full = true;
+        if (FAIL == m_policy) {
+            return false;
+        }
+
+        m_cond_room.wait(lock, [this]() { return m_exiting || !m_high || m_queue.size() <= m_low; });
+    }
+
+    return !m_exiting;
+}
+
+template<class type>
+inline void block_queue<type>::taken(std::unique_lock<std::mutex>& lock) {
+    if (!m_full || m_low < m_queue.size()) {
+        return;
+    }
+
+    m_full = false;
+    m_cond_room.notify_all();
+    writable_notify notify = m_on_writable;
+    lock.unlock();
+    if (notify) {
+        notify();
+    }
+}
+
+template<class type>
+inline void block_queue<type>::wait_objects(std::unique_lock<std::mutex>& lock) {
+    while (WAIT_BLOCK != m_wait_mode && m_queue.empty() && !m_exiting) {
+        if (!spin_until_woken(lock, m_wakes, m_wait_mode, m_spins)) {
+            break;
+        }
+    }
+
+    m_cond_has.wait(lock, [this]() { return !m_queue.empty() || m_exiting; });
+}
+
+template<class type>
+inline void block_queue<type>::wake_takers() {
+    m_wakes.fetch_add(1, std::memory_order_release);
+    m_cond_has.notify_all();
 }
 
 #endif
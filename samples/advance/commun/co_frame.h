@@ -0,0 +1,69 @@
+/*
+  MIT License
+
+  Copyright (c) 2025 Kong Pengsheng
+
+  Permission is hereby granted, free of charge, to any person obtaining a copy
+  of this software and associated documentation files (the "Software"), to deal
+  in the Software without restriction, including without limitation the rights
+  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+  copies of the Software, and to permit persons to whom the Software is
+  furnished to do so, subject to the following conditions:
+
+  The above copyright notice and this permission notice shall be included in all
+  copies or substantial portions of the Software.
+
+  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+  SOFTWARE.
+*/
+
+#ifndef CO_FRAME_H
+#define CO_FRAME_H
+
+// awaitable data_frame io, the coroutine counterpart of the send and recv
+// threads of commun_endpoint, for C++20 builds.
+
+#include "co_endpoint.h"
+#include "data_frame.h"
+
+#if defined(__cpp_impl_coroutine) && __has_include(<coroutine>)
+
+inline co_task<bool> co_send_frame(endpoint* ep, data_frame frame) {
+    if (!frame.size_valid()) {
+        co_return false;
+    }
+
+    co_return co_await co_full_send(ep, frame.get_buffer(), frame.get_size());
+}
+
+// the frame is not size_valid once disconnected, broken frames are skipped like commun_endpoint does.
+inline co_task<data_frame> co_recv_frame(endpoint* ep) {
+    while (true) {
+        data_frame frame;
+        const int head_size = sizeof(data_frame::size_type);
+        if (!co_await co_full_recv(ep, frame.get_buffer(), head_size)) {
+            co_return data_frame();
+        }
+
+        if (!frame.size_valid()) {
+            continue;
+        }
+
+        if (!co_await co_full_recv(ep, frame.get_buffer() + head_size, frame.get_size() - head_size)) {
+            co_return data_frame();
+        }
+
+        if (frame.checksum_valid()) {
+            co_return frame;
+        }
+    }
+}
+
+#endif
+
+#endif
@@ -319,9 +319,9 @@ void commun_base::on_req_fragment(const data_frame::byte_type* fragment, data_fr
         m_receiving_file.put(fragment, size);
         send_command(COMMAND_RSP_FRAGMENT, COMMUN_ANSWER_ACCEPT);
     } else {
-        m_receiving_file.take([this](char* buffer, int size) {
+        m_receiving_file.take_contiguous([this](char* buffer, int size) {
             on_file(m_receiving_command, m_receiving_name, buffer, size);
             return size;
-        }, false);
+        }, m_receiving_file.size(), false);
     }
 }
@@ -117,13 +117,13 @@ private:
     int m_send_timeout = DEFAULT_SEND_TIMEOUT;
     bool m_busying = false;
     block_queue<sending_object> m_sending_queue;
-    byte_queue m_sending_file;
+    byte_queue m_sending_file{byte_queue::CHUNK_SIZE};
 
     std::future<void> m_recv_future;
     std::string m_recv_dir;
     commun_command m_receiving_command;
     std::string m_receiving_name;
-    byte_queue m_receiving_file;
+    byte_queue m_receiving_file{byte_queue::CHUNK_SIZE};
 
     std::future<void> m_ping_future;
     std::mutex m_ping_mutex;
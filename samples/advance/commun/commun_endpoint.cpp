@@ -23,8 +23,53 @@
 */
 
 #include "commun_endpoint.h"
+#include <algorithm>
+#include <vector>
+#include "buffered_reader.h"
+#include "websocket.h"
+
+const size_t MAX_SEND_FRAMES = 64;
+// a peer slower than us holds senders back at this many frames, about 4 MB
+const size_t MAX_QUEUED_FRAMES = 1024;
+const size_t RESUME_QUEUED_FRAMES = MAX_QUEUED_FRAMES / 2;
+
+// sendv may take part of the buffers, the rest follows until all went out
+static bool full_sendv(endpoint* ep, const endpoint::const_buffer* buffers, int count) {
+    endpoint::const_buffer rest[MAX_SEND_FRAMES];
+    std::copy(buffers, buffers + count, rest);
+    int first = 0;
+    while (first < count) {
+        int res = ep->sendv(rest + first, count - first);
+        if (res <= 0) {
+            return false;
+        }
+
+        while (first < count && rest[first].size <= res) {
+            res -= rest[first++].size;
+        }
+
+        if (first < count) {
+            rest[first].data += res;
+            rest[first].size -= res;
+        }
+    }
+
+    return true;
+}
+
+static bool send_messages(endpoint* ep, const endpoint::const_buffer* buffers, int count) {
+    websocket* ws = static_cast<websocket*>(ep);
+    for (int i = 0; i < count; ++i) {
+        if (ws->send_message(WS_OPCODE_BINARY, buffers[i].data, buffers[i].size) != buffers[i].size) {
+            return false;
+        }
+    }
+
+    return true;
+}
 
 commun_endpoint::commun_endpoint() {
+    m_send_queue.set_watermarks(MAX_QUEUED_FRAMES, RESUME_QUEUED_FRAMES);
 }
 
 commun_endpoint::~commun_endpoint() {
@@ -41,6 +86,7 @@ bool commun_endpoint::start(const endpoint_params& params) {
         return false;
     }
 
+    m_messages = endpoint::WEBSOCKET == params.type && m_endpoint->set_option(endpoint::OPTION_MESSAGES, 1);
     endpoint::connected_notify notify = std::bind(&commun_endpoint::on_connected, this);
     bool res = false;
     switch (params.role) {
@@ -70,6 +116,14 @@ bool commun_endpoint::stop() {
     }
 
     m_endpoint->close();
+    if (m_recv_future.valid()) {
+        m_recv_future.wait();
+    }
+
+    if (m_send_future.valid()) {
+        m_send_future.wait();
+    }
+
     endpoint::destroy(m_endpoint);
     m_endpoint = nullptr;
 
@@ -99,41 +153,77 @@ data_frame commun_endpoint::recv() {
 }
 
 void commun_endpoint::on_connected() {
+    m_send_queue.clear();
+    m_recv_queue.clear();
+    // frames queued meanwhile leave together in one gathered send
     m_send_future = std::async(std::launch::async, [this] {
-        m_send_queue.clear();
-        while (true) {
-            data_frame frame(m_send_queue.take());
-            if (!frame.size_valid()) {
+        bool running = true;
+        while (running) {
+            std::vector<data_frame> frames(m_send_queue.take(MAX_SEND_FRAMES));
+            if (frames.empty()) {
                 break;
             }
 
-            if (!m_endpoint || !m_endpoint->full_send(frame.get_buffer(), frame.get_size())) {
+            std::vector<endpoint::const_buffer> buffers;
+            for (data_frame& frame : frames) {
+                if (!frame.size_valid()) {
+                    running = false;
+                    break;
+                }
+
+                buffers.push_back({(const char*)frame.get_buffer(), (int)frame.get_size()});
+            }
+
+            if (!m_endpoint) {
                 break;
             }
 
-            if (m_notify) {
+            bool sent = m_messages ? send_messages(m_endpoint, buffers.data(), (int)buffers.size()) :
+                full_sendv(m_endpoint, buffers.data(), (int)buffers.size());
+            if (!sent) {
+                break;
+            }
+
+            for (size_t i = 0; m_notify && i < buffers.size(); ++i) {
                 void* info = nullptr;
-                memcpy(&info, frame.get_buffer(), sizeof(data_frame::size_type) + sizeof(data_frame::command_type));
+                memcpy(&info, buffers[i].data, sizeof(data_frame::size_type) + sizeof(data_frame::command_type));
                 m_notify(SENT, info);
             }
         }
+
+        // nobody drains the queue any more, senders held back must not wait for it
+        m_send_queue.exit();
     });
 
+    // frames come out of one read ahead buffer, not a recv for each head and body. a
+    // message is a whole frame, one recv_message takes it
     m_recv_future = std::async(std::launch::async, [this] {
-        m_recv_queue.clear();
+        buffered_reader reader(m_endpoint);
         while (true) {
             data_frame frame;
             const int head_size = sizeof(data_frame::size_type);
-            if (!m_endpoint || !m_endpoint->full_recv(frame.get_buffer(), head_size)) {
-                break;
-            }
-
-            if (!frame.size_valid()) {
-                continue;
-            }
-
-            if (!m_endpoint || !m_endpoint->full_recv(frame.get_buffer() + head_size, frame.get_size() - head_size)) {
-                break;
+            if (m_messages) {
+                ws_opcode opcode;
+                int res = m_endpoint ? static_cast<websocket*>(m_endpoint)->recv_message(frame.get_buffer(), data_frame::BUFFER_SIZE, opcode) : -1;
+                if (res < 0) {
+                    break;
+                }
+
+                if (!frame.size_valid() || frame.get_size() != res) {
+                    continue;
+                }
+            } else {
+                if (!m_endpoint || !reader.read(frame.get_buffer(), head_size)) {
+                    break;
+                }
+
+                if (!frame.size_valid()) {
+                    continue;
+                }
+
+                if (!m_endpoint || !reader.read(frame.get_buffer() + head_size, frame.get_size() - head_size)) {
+                    break;
+                }
             }
 
             if (!frame.checksum_valid()) {
@@ -150,7 +240,7 @@ void commun_endpoint::on_connected() {
             }
         }
 
-        m_send_queue.put(data_frame());
+        m_send_queue.exit();
         m_recv_queue.put(data_frame());
 
         if (m_notify) {
@@ -66,6 +66,8 @@ public:
 
 public:
     void set_notify(endpoint_notify notify) { m_notify = notify; }
+    // how recv waits for the receiving thread to hand a frame over
+    void set_recv_wait(wait_mode mode, int spins = 0) { m_recv_queue.set_wait(mode, spins); }
     bool is_connected() const { return m_endpoint && m_endpoint->is_connected(); }
     bool start(const endpoint_params& params);
     bool stop();
@@ -80,6 +82,8 @@ private:
 private:
     endpoint_notify m_notify = nullptr;
     endpoint* m_endpoint = nullptr;
+    // a websocket carries each frame as a message of its own, its size comes with it
+    bool m_messages = false;
     std::future<void> m_send_future, m_recv_future;
     block_queue<data_frame> m_send_queue, m_recv_queue;
 };
@@ -0,0 +1,415 @@
+/*
+  MIT License
+
+  Copyright (c) 2025 Kong Pengsheng
+
+  Permission is hereby granted, free of charge, to any person obtaining a copy
+  of this software and associated documentation files (the "Software"), to deal
+  in the Software without restriction, including without limitation the rights
+  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+  copies of the Software, and to permit persons to whom the Software is
+  furnished to do so, subject to the following conditions:
+
+  The above copyright notice and this permission notice shall be included in all
+  copies or substantial portions of the Software.
+
+  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+  SOFTWARE.
+*/
+
+#include <iostream>
+#include <iomanip>
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdlib>
+#include <future>
+#include <new>
+#include <string>
+#include <thread>
+#include <vector>
+#include "byte_queue.h"
+#include "byte_ring.h"
+#include "commun_endpoint.h"
+#include "ws_mask.h"
+
+// one way throughput through a stack, over INPROC by default so what shows is the cost
+// of the layers alone. a websocket runs in memory as type 2 with info inproc:name.
+// bench [type] [info] [message size] [message count] [endpoint|commun|handoff|mask] [flush delay]
+// a flush delay in microseconds lets the sending endpoint gather its sends.
+// datagram types, UDP and NETSIM over udp:, count what arrives and report the rest lost.
+// heap allocations made by the whole process while messages flow are counted too.
+// handoff in place of endpoint or commun ignores the type, info and size and instead
+// times count handoffs of a stamp through byte_queue, byte_ring as behind a websocket
+// recv and block_queue as behind a commun recv, once per wait mode, and prints the
+// latency histogram of each. the stamps come one by one, the taker idles in between.
+// mask ignores all but the mode and times each websocket masking kernel the cpu runs on
+// payloads from 16 bytes to 16 MB, copying as a send does and in place.
+
+using clock_type = std::chrono::steady_clock;
+
+const int HANDOFF_SPINS = 10000;
+// long enough for a blocking taker to be asleep when the next stamp comes
+const std::chrono::microseconds HANDOFF_GAP(20);
+// masked by each kernel at each payload size
+const long long MASK_BYTES = 1024LL * 1024 * 256;
+// how long the receiver of datagrams waits for stragglers once the last is sent
+const std::chrono::seconds DATAGRAM_LINGER(1);
+
+static std::atomic<long long> allocations(0);
+
+void* operator new(std::size_t size) {
+    allocations.fetch_add(1, std::memory_order_relaxed);
+    if (void* p = std::malloc(size ? size : 1)) {
+        return p;
+    }
+
+    throw std::bad_alloc();
+}
+
+void operator delete(void* p) noexcept {
+    std::free(p);
+}
+
+void operator delete(void* p, std::size_t) noexcept {
+    std::free(p);
+}
+
+struct bench_params {
+    endpoint::endpoint_type type = endpoint::INPROC;
+    std::string info = "bench";
+    int size = 1024;
+    int count = 100000;
+    bool commun = false;
+    bool handoff = false;
+    bool mask = false;
+    int flush_delay = 0;
+};
+
+void print_result(const bench_params& params, clock_type::duration elapsed, long long allocated, int passed) {
+    double seconds = std::chrono::duration<double>(elapsed).count();
+    std::cout << (params.commun ? "commun" : "endpoint") << " over type " << params.type << ", "
+              << passed << "/" << params.count << " messages of " << params.size << " bytes in "
+              << std::fixed << std::setprecision(1) << seconds * 1000 << " ms, "
+              << std::setprecision(0) << passed / seconds << " msg/s, "
+              << std::setprecision(1) << (double)passed * params.size / seconds / (1024 * 1024) << " MB/s, "
+              << std::setprecision(2) << (passed ? (double)allocated / passed : 0) << " allocations/msg" << std::endl;
+}
+
+// a datagram listener connects only once the first datagram comes, and one that is lost
+// never comes at all
+static bool is_datagram(const bench_params& params) {
+    return endpoint::UDP == params.type || (endpoint::NETSIM == params.type && 0 == params.info.compare(0, 4, "udp:"));
+}
+
+bool bench_endpoint(const bench_params& params) {
+    endpoint* server = endpoint::create(params.type, params.info);
+    endpoint* client = endpoint::create(params.type);
+    if (!server || !client) {
+        return false;
+    }
+
+    if (params.flush_delay) {
+        client->set_option(endpoint::OPTION_FLUSH_DELAY, params.flush_delay);
+    }
+
+    std::promise<void> server_connected, client_connected;
+    if (!server->listen([&server_connected] { server_connected.set_value(); }) ||
+        !client->connect(server->info(), [&client_connected] { client_connected.set_value(); })) {
+        endpoint::destroy(client);
+        endpoint::destroy(server);
+        return false;
+    }
+
+    bool datagram = is_datagram(params);
+    std::shared_future<void> server_ready = server_connected.get_future();
+    if (!datagram) {
+        server_ready.wait();
+    }
+    client_connected.get_future().wait();
+
+    long long total = (long long)params.size * params.count;
+    std::vector<char> message(params.size, 'b');
+    long long allocated = allocations;
+    clock_type::time_point start = clock_type::now();
+    clock_type::time_point last = start;
+    std::atomic<bool> stopped(false);
+    std::future<long long> received = std::async(std::launch::async, [server, total, server_ready, &last, &stopped] {
+        // recv of a datagram listener returns at once until the first one came
+        while (std::future_status::timeout == server_ready.wait_for(std::chrono::milliseconds(10))) {
+            if (stopped) {
+                return 0LL;
+            }
+        }
+
+        std::vector<char> buffer(1024 * 64);
+        long long size = 0;
+        while (size < total) {
+            int res = server->recv(buffer.data(), (int)buffer.size());
+            if (res <= 0) {
+                break;
+            }
+            size += res;
+            last = clock_type::now();
+        }
+        return size;
+    });
+
+    for (int i = 0; i < params.count && client->full_send(message.data(), params.size); ++i) {
+    }
+
+    // disconnect wakes a receiver still waiting for datagrams that were lost
+    if (datagram && std::future_status::timeout == received.wait_for(DATAGRAM_LINGER)) {
+        stopped = true;
+        server->disconnect();
+    }
+
+    long long size = received.get();
+    clock_type::duration elapsed = (size ? last : clock_type::now()) - start;
+    int passed = (int)(size / params.size);
+    print_result(params, elapsed, allocations - allocated, passed);
+    if (datagram && passed < params.count) {
+        std::cout << params.count - passed << " datagrams lost" << std::endl;
+    }
+
+    endpoint::destroy(client);
+    endpoint::destroy(server);
+    return size == total || (datagram && 0 < size);
+}
+
+bool bench_commun(const bench_params& params) {
+    std::promise<void> server_connected, client_connected;
+    commun_endpoint server, client;
+    server.set_notify([&server_connected](commun_endpoint::endpoint_event event, void* info) {
+        if (commun_endpoint::CONNECTED == event) {
+            server_connected.set_value();
+        }
+    });
+    client.set_notify([&client_connected](commun_endpoint::endpoint_event event, void* info) {
+        if (commun_endpoint::CONNECTED == event) {
+            client_connected.set_value();
+        }
+    });
+
+    if (!server.start({params.type, commun_endpoint::SERVER, params.info, std::string()}) ||
+        !client.start({params.type, commun_endpoint::CLIENT, std::string(), params.info})) {
+        return false;
+    }
+
+    server_connected.get_future().wait();
+    client_connected.get_future().wait();
+
+    std::vector<data_frame::byte_type> data(params.size, 'b');
+    long long allocated = allocations;
+    clock_type::time_point start = clock_type::now();
+    std::future<int> received = std::async(std::launch::async, [&server, &params] {
+        int count = 0;
+        while (count < params.count && server.recv().size_valid()) {
+            ++count;
+        }
+        return count;
+    });
+
+    for (int i = 0; i < params.count; ++i) {
+        client.send(data_frame(1, data.data(), (data_frame::size_type)params.size));
+    }
+
+    int count = received.get();
+    clock_type::duration elapsed = clock_type::now() - start;
+    print_result(params, elapsed, allocations - allocated, count);
+    return count == params.count;
+}
+
+struct wait_params {
+    const char* name;
+    wait_mode mode;
+    int spins;
+};
+
+static long long now_ns() {
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(clock_type::now().time_since_epoch()).count();
+}
+
+// stamps go one at a time, the next once the last is taken and the gap has passed
+template<class put_t, class take_t>
+std::vector<long long> measure_handoffs(int count, put_t put, take_t take) {
+    std::vector<long long> latencies;
+    latencies.reserve(count);
+    std::atomic<int> taken(0);
+    std::thread taker([&latencies, &taken, &take, count] {
+        for (int i = 0; i < count; ++i) {
+            long long stamp = take();
+            latencies.push_back(now_ns() - stamp);
+            taken.store(i + 1, std::memory_order_release);
+        }
+    });
+
+    for (int i = 0; i < count; ++i) {
+        clock_type::time_point idle = clock_type::now() + HANDOFF_GAP;
+        while (taken.load(std::memory_order_acquire) < i || clock_type::now() < idle) {
+        }
+        put(now_ns());
+    }
+
+    taker.join();
+    return latencies;
+}
+
+void print_histogram(const char* queue, const wait_params& wait, std::vector<long long>& latencies) {
+    std::sort(latencies.begin(), latencies.end());
+    auto at = [&latencies](double rank) { return latencies[std::min((size_t)(rank * latencies.size()), latencies.size() - 1)] / 1000.0; };
+    std::cout << "handoff through " << queue << " waiting " << wait.name << ", " << latencies.size() << " stamps, "
+              << std::fixed << std::setprecision(2) << "p50 " << at(0.5) << " us, p90 " << at(0.9) << " us, p99 "
+              << at(0.99) << " us, p99.9 " << at(0.999) << " us, max " << latencies.back() / 1000.0 << " us" << std::endl;
+
+    // buckets double from a quarter microsecond
+    long long bound = 250;
+    size_t first = 0;
+    while (first < latencies.size()) {
+        size_t last = std::lower_bound(latencies.begin() + first, latencies.end(), bound) - latencies.begin();
+        if (first < last) {
+            std::cout << "    < " << std::setw(9) << std::setprecision(2) << bound / 1000.0 << " us "
+                      << std::setw(8) << last - first << std::endl;
+        }
+        first = last;
+        bound *= 2;
+    }
+}
+
+bool bench_handoff(const bench_params& params) {
+    const wait_params waits[] = {
+        {"block", WAIT_BLOCK, 0},
+        {"spin", WAIT_SPIN, HANDOFF_SPINS},
+        {"poll", WAIT_POLL, 0}
+    };
+
+    for (const wait_params& wait : waits) {
+        byte_queue bytes;
+        bytes.set_wait(wait.mode, wait.spins);
+        std::vector<long long> latencies = measure_handoffs(params.count, [&bytes](long long stamp) {
+            bytes.put((const char*)&stamp, sizeof(stamp));
+        }, [&bytes] {
+            long long stamp = 0;
+            bytes.take((char*)&stamp, sizeof(stamp));
+            return stamp;
+        });
+        print_histogram("byte_queue", wait, latencies);
+
+        byte_ring ring;
+        ring.set_wait(wait.mode, wait.spins);
+        latencies = measure_handoffs(params.count, [&ring](long long stamp) {
+            ring.put((const char*)&stamp, sizeof(stamp));
+        }, [&ring] {
+            long long stamp = 0;
+            ring.take((char*)&stamp, sizeof(stamp));
+            return stamp;
+        });
+        print_histogram("byte_ring", wait, latencies);
+
+        block_queue<long long> objects;
+        objects.set_wait(wait.mode, wait.spins);
+        latencies = measure_handoffs(params.count, [&objects](long long stamp) {
+            objects.put(stamp);
+        }, [&objects] {
+            return objects.take();
+        });
+        print_histogram("block_queue", wait, latencies);
+    }
+
+    return true;
+}
+
+double mask_speed(ws_mask_kernel kernel, std::vector<char>& src, std::vector<char>& dest, bool in_place) {
+    static const unsigned char key[4] = {0x12, 0x34, 0x56, 0x78};
+    ws_mask_select(kernel);
+    long long rounds = std::max(MASK_BYTES / (long long)src.size(), 1LL);
+    clock_type::time_point start = clock_type::now();
+    for (long long i = 0; i < rounds; ++i) {
+        if (in_place) {
+            ws_mask(src.data(), src.size(), key);
+        } else {
+            ws_mask(src.data(), dest.data(), src.size(), key);
+        }
+    }
+
+    double seconds = std::chrono::duration<double>(clock_type::now() - start).count();
+    return rounds * src.size() / seconds / (1024 * 1024 * 1024);
+}
+
+bool bench_mask() {
+    static const char* const NAMES[] = {"scalar", "word", "sse2", "avx2", "avx512"};
+    ws_mask_kernel selected = ws_mask_selected();
+    for (bool in_place : {false, true}) {
+        for (size_t size = 16; size <= 1024 * 1024 * 16; size *= 4) {
+            std::vector<char> src(size, 'b'), dest(size);
+            std::cout << "mask " << (in_place ? "in place " : "copying ") << std::setw(8) << size << " bytes,";
+            double scalar = 0;
+            for (int kernel = WS_MASK_SCALAR; kernel <= selected; ++kernel) {
+                double speed = mask_speed((ws_mask_kernel)kernel, src, dest, in_place);
+                scalar = scalar ? scalar : speed;
+                std::cout << " " << NAMES[kernel] << " " << std::fixed << std::setprecision(2) << speed << " GB/s";
+                if (WS_MASK_SCALAR != kernel) {
+                    std::cout << " (x" << std::setprecision(1) << speed / scalar << ")";
+                }
+            }
+            std::cout << std::endl;
+        }
+    }
+
+    ws_mask_select(selected);
+    return true;
+}
+
+int main(int argc, const char* argv[]) {
+    bench_params params;
+    if (1 < argc) {
+        params.type = (endpoint::endpoint_type)atoi(argv[1]);
+    }
+
+    if (2 < argc) {
+        params.info = argv[2];
+    }
+
+    if (3 < argc) {
+        params.size = atoi(argv[3]);
+    }
+
+    if (4 < argc) {
+        params.count = atoi(argv[4]);
+    }
+
+    if (5 < argc) {
+        params.commun = std::string("commun") == argv[5];
+        params.handoff = std::string("handoff") == argv[5];
+        params.mask = std::string("mask") == argv[5];
+    }
+
+    if (6 < argc) {
+        params.flush_delay = atoi(argv[6]);
+    }
+
+    if (params.size <= 0 || params.count <= 0 || (params.commun && data_frame::MAX_DATA_SIZE < params.size)) {
+        std::cout << "bad message size or count." << std::endl;
+        return -1;
+    }
+
+    bool res = false;
+    if (params.mask) {
+        res = bench_mask();
+    } else if (params.handoff) {
+        res = bench_handoff(params);
+    } else {
+        res = params.commun ? bench_commun(params) : bench_endpoint(params);
+    }
+    if (!res) {
+        std::cout << "bench failed." << std::endl;
+        return -1;
+    }
+
+    return 0;
+}
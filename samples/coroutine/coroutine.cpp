@@ -0,0 +1,137 @@
+/*
+  MIT License
+
+  Copyright (c) 2025 Kong Pengsheng
+
+  Permission is hereby granted, free of charge, to any person obtaining a copy
+  of this software and associated documentation files (the "Software"), to deal
+  in the Software without restriction, including without limitation the rights
+  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+  copies of the Software, and to permit persons to whom the Software is
+  furnished to do so, subject to the following conditions:
+
+  The above copyright notice and this permission notice shall be included in all
+  copies or substantial portions of the Software.
+
+  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+  SOFTWARE.
+*/
+
+#include <iostream>
+#include <atomic>
+#include <condition_variable>
+#include <mutex>
+#include "co_frame.h"
+
+#if defined(__cpp_impl_coroutine) && __has_include(<coroutine>)
+
+const int FRAME_COUNT = 100;
+
+std::mutex done_mutex;
+std::condition_variable done_condition;
+int running_clients = 0;
+std::atomic<int> passed_clients(0);
+
+co_task<> echo_session(endpoint* session) {
+    while (true) {
+        data_frame frame = co_await co_recv_frame(session);
+        if (!frame.size_valid() || !co_await co_send_frame(session, std::move(frame))) {
+            break;
+        }
+    }
+
+    endpoint::destroy(session);
+}
+
+co_task<> accept_sessions(co_acceptor& acceptor) {
+    while (endpoint* session = co_await acceptor.accept()) {
+        co_spawn(echo_session(session));
+    }
+}
+
+co_task<> run_client(endpoint::endpoint_type type, std::string remote_info, int index) {
+    endpoint* ep = endpoint::create(type);
+    bool passed = co_await co_connect(ep, remote_info);
+    for (int count = 0; passed && count < FRAME_COUNT; ++count) {
+        std::string data = std::to_string(index) + ":" + std::to_string(count);
+        passed = co_await co_send_frame(ep, data_frame(count, data.data(), (data_frame::size_type)data.size()));
+
+        data_frame frame = co_await co_recv_frame(ep);
+        passed = passed && frame.size_valid() && frame.get_command() == count
+            && std::string(frame.get_data(), frame.get_data_size()) == data;
+    }
+
+    ep->disconnect();
+    endpoint::destroy(ep);
+
+    if (passed) {
+        ++passed_clients;
+    }
+
+    std::lock_guard<std::mutex> lock(done_mutex);
+    --running_clients;
+    done_condition.notify_all();
+}
+
+int main(int argc, const char* argv[]) {
+    endpoint::endpoint_type type = endpoint::TCP;
+    if (1 < argc) {
+        type = (endpoint::endpoint_type)atoi(argv[1]);
+    }
+
+    std::string info = "127.0.0.1";
+    if (2 < argc) {
+        info = argv[2];
+    }
+
+    int client_count = 100;
+    if (3 < argc) {
+        client_count = atoi(argv[3]);
+    }
+
+    endpoint* server = endpoint::create(type, info);
+    if (!server) {
+        std::cout << "create endpoint failed." << std::endl;
+        return -1;
+    }
+
+    co_acceptor acceptor(server);
+    if (!acceptor.start()) {
+        std::cout << "serve failed." << std::endl;
+        return -1;
+    }
+
+    std::cout << "server started, " << server->info() << std::endl;
+    co_spawn(accept_sessions(acceptor));
+
+    running_clients = client_count;
+    for (int index = 0; index < client_count; ++index) {
+        co_spawn(run_client(type, server->info(), index));
+    }
+
+    {
+        std::unique_lock<std::mutex> lock(done_mutex);
+        done_condition.wait(lock, [] { return 0 == running_clients; });
+    }
+
+    std::cout << passed_clients << "/" << client_count << " clients echoed " << FRAME_COUNT << " frames." << std::endl;
+
+    acceptor.close();
+    endpoint::destroy(server);
+
+    return passed_clients == client_count ? 0 : -1;
+}
+
+#else
+
+int main(int argc, const char* argv[]) {
+    std::cout << "coroutines need a C++20 compiler." << std::endl;
+    return -1;
+}
+
+#endif